@@ -0,0 +1,97 @@
+/*
+ *  Blocking thread barrier on a futex.
+ *
+ *  The threaded tests used to spin on arrays of flags while waiting
+ *  for the other threads, which steals the CPU from the threads being
+ *  measured when there are more threads than cores.  Here, waiting
+ *  threads sleep in the kernel (FUTEX_WAIT) until the last thread
+ *  arrives and wakes them all.
+ *
+ *  The barrier is reusable: the last thread to arrive bumps the
+ *  generation, and the others wait for the generation to change.  It
+ *  also measures each transition: the wake latency is the time from
+ *  the last arrival to each waiter running again.
+ *
+ *  Copyright (c) 2009-2013, Rice University.
+ *  See the file LICENSE for details.
+ */
+
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <linux/futex.h>
+#include <err.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "papi-tests.h"
+
+static void
+futex_wait(volatile int *addr, int val)
+{
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void
+futex_wake(volatile int *addr)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+void
+barrier_init(struct barrier *bar, int num)
+{
+    bar->num = num;
+    bar->count = 0;
+    bar->gen = 0;
+    bar->release = 0;
+    bar->crossings = 0;
+    bar->wakes = 0;
+    bar->wake_total = 0;
+    bar->wake_max = 0;
+}
+
+/*
+ *  Wait for all num threads to arrive.  Returns: 1 in the last thread
+ *  to arrive, else 0.
+ */
+int
+barrier_wait(struct barrier *bar)
+{
+    long lat, max;
+    int gen;
+
+    gen = bar->gen;
+    if (__sync_add_and_fetch(&bar->count, 1) == bar->num) {
+	bar->count = 0;
+	bar->crossings++;
+	bar->release = time_ns();
+	__sync_fetch_and_add(&bar->gen, 1);
+	futex_wake(&bar->gen);
+	return 1;
+    }
+
+    /* FUTEX_WAIT returns at once if gen has already changed. */
+    while (bar->gen == gen) {
+	futex_wait(&bar->gen, gen);
+    }
+
+    lat = time_ns() - bar->release;
+    __sync_fetch_and_add(&bar->wakes, 1);
+    __sync_fetch_and_add(&bar->wake_total, lat);
+    do {
+	max = bar->wake_max;
+    }
+    while (lat > max && ! __sync_bool_compare_and_swap(&bar->wake_max, max, lat));
+
+    return 0;
+}
+
+void
+barrier_print(struct barrier *bar, char *name)
+{
+    printf("%s barrier: crossings: %ld, wake latency avg: %.1f usec, "
+	   "max: %.1f usec\n", name, bar->crossings,
+	   bar->wake_total / (1000.0 * MAX(bar->wakes, 1)),
+	   bar->wake_max / 1000.0);
+}
@@ -0,0 +1,113 @@
+/*
+ *  Kernel for branch mispredictions with a tunable rate.
+ *
+ *  The loop branches on each byte of a 64K table.  With -b pct, each
+ *  byte is random (0 or 1) with probability pct/100 and otherwise 1,
+ *  so the branch runs from perfectly predictable (-b 0) to a coin
+ *  flip (-b 100), and the mispredict rate is about pct/2 percent of
+ *  the data branches.  The table is much longer than any predictor
+ *  history, so the predictor can't learn the random bytes.
+ *
+ *  The loop is written in asm so that the compiler can't turn the
+ *  branch into a cmov.  Each iteration retires exactly two conditional
+ *  branches (the data branch and the loop branch) and no unconditional
+ *  ones, so this kernel has a known count for PAPI_BR_CN and
+ *  PAPI_BR_INS.
+ *
+ *  Copyright (c) 2009-2013, Rice University.
+ *  See the file LICENSE for details.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "papi-tests.h"
+
+#ifdef __x86_64__
+
+#define BRANCH_SIZE   65536
+#define BRANCH_BR     2
+#define BRANCH_SCALE  500000
+
+static unsigned char *branch_table = NULL;
+static long *branch_ones = NULL;
+
+/*
+ *  Fill the table and branch_ones[k] = number of ones in the first k
+ *  bytes, so run can check the count of not-taken branches.
+ */
+static void
+branch_init(struct prog_args *args)
+{
+    long seed, k;
+
+    branch_table = malloc(BRANCH_SIZE);
+    branch_ones = malloc((BRANCH_SIZE + 1) * sizeof(long));
+    if (branch_table == NULL || branch_ones == NULL) {
+	errx(1, "%s: out of memory", __func__);
+    }
+
+    seed = 1;
+    branch_ones[0] = 0;
+    for (k = 0; k < BRANCH_SIZE; k++) {
+	seed = random_gen(seed);
+	branch_table[k] = 1;
+	if (seed % 100 < args->branch_pct) {
+	    seed = random_gen(seed);
+	    branch_table[k] = seed % 2;
+	}
+	branch_ones[k + 1] = branch_ones[k] + branch_table[k];
+    }
+}
+
+/*
+ *  Per iteration: load, test, jz (data branch), maybe add, add, and,
+ *  dec, jnz (loop branch).  Each unit starts at the beginning of the
+ *  table, so the number of ones is known.
+ */
+static int
+branch_run(struct memory_state *mstate, int work)
+{
+    long n, k, ones, expect;
+    int num_errs = 0;
+
+    for (; work > 0; work--) {
+	n = branch_kernel.scale;
+	k = 0;
+	ones = 0;
+	asm volatile (
+	    "1:\n\t"
+	    "movzbl (%[tab],%[k]), %%eax\n\t"
+	    "test   %%eax, %%eax\n\t"
+	    "jz     2f\n\t"
+	    "add    $1, %[ones]\n"
+	    "2:\n\t"
+	    "add    $1, %[k]\n\t"
+	    "and    %[mask], %[k]\n\t"
+	    "dec    %[n]\n\t"
+	    "jnz    1b\n\t"
+	    : [n] "+r" (n), [k] "+r" (k), [ones] "+r" (ones)
+	    : [tab] "r" (branch_table), [mask] "i" (BRANCH_SIZE - 1)
+	    : "eax", "cc", "memory");
+
+	expect = (branch_kernel.scale / BRANCH_SIZE) * branch_ones[BRANCH_SIZE]
+	    + branch_ones[branch_kernel.scale % BRANCH_SIZE];
+	if (ones != expect) {
+	    warnx("%s: count is out of range: %ld, expected %ld",
+		  __func__, ones, expect);
+	    num_errs++;
+	}
+    }
+
+    return (num_errs);
+}
+
+struct work_kernel branch_kernel = {
+    "branch", "data dependent branches, -b percent random",
+    "PAPI_BR_MSP PAPI_BR_CN PAPI_BR_INS PAPI_BR_PRC",
+    branch_init, NULL, NULL, branch_run, BRANCH_SCALE,
+    0, BRANCH_BR, 0, 0, 0,
+};
+
+#endif
@@ -0,0 +1,299 @@
+/*
+ *  Calibrate the kernel scales for this machine.
+ *
+ *  The built-in scales (FLOPS_SCALE, etc) were tuned for one old
+ *  machine, so on other machines a unit of work can be much shorter
+ *  or longer than intended.  Instead, time each kernel and resize its
+ *  scale so that one unit of work takes the -u time (default 1000
+ *  usec, so 1000 units is about one second).
+ *
+ *  The results are cached in a file keyed by the CPU model and
+ *  frequency, so later runs on the same kind of machine start
+ *  immediately.  The file is $PAPI_TESTS_CALIB, or else
+ *  $HOME/.papi-tests-calib, with one line per kernel:
+ *
+ *    model <tab> freq <tab> kernel <tab> usec <tab> scale
+ *
+ *  Copyright (c) 2009-2013, Rice University.
+ *  See the file LICENSE for details.
+ */
+
+#include <sys/time.h>
+#include <err.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "papi-tests.h"
+
+#define CALIB_TIME   0.20
+#define CALIB_PASSES  2
+#define LINE_SIZE  1024
+
+static char cpu_model[LINE_SIZE];
+static char cpu_freq[LINE_SIZE];
+
+/*
+ *  Fill in cpu_model and cpu_freq from /proc/cpuinfo and the cpufreq
+ *  max frequency, if available.  The current MHz in cpuinfo moves
+ *  around with frequency scaling, so round it to 100 MHz.
+ */
+static void
+get_cpu_key(void)
+{
+    char line[LINE_SIZE], khz[100], *p;
+    double mhz = 0.0;
+    FILE *fp;
+
+    strcpy(cpu_model, "unknown");
+    strcpy(cpu_freq, "unknown");
+
+    fp = fopen("/proc/cpuinfo", "r");
+    if (fp != NULL) {
+	while (fgets(line, LINE_SIZE, fp) != NULL) {
+	    p = strchr(line, ':');
+	    if (p == NULL)
+		continue;
+	    if (strncmp(line, "model name", 10) == 0
+		|| (strncmp(line, "cpu\t", 4) == 0 && strcmp(cpu_model, "unknown") == 0))
+	    {
+		for (p++; *p == ' '; p++)
+		    ;
+		p[strcspn(p, "\t\n")] = 0;
+		strncpy(cpu_model, p, LINE_SIZE - 1);
+	    }
+	    else if (strncmp(line, "cpu MHz", 7) == 0 && mhz == 0.0) {
+		sscanf(p + 1, "%lf", &mhz);
+	    }
+	}
+	fclose(fp);
+    }
+
+    fp = fopen("/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq", "r");
+    if (fp != NULL && fgets(khz, sizeof(khz), fp) != NULL) {
+	khz[strcspn(khz, "\n")] = 0;
+	snprintf(cpu_freq, LINE_SIZE, "%s kHz", khz);
+    }
+    else if (mhz > 0.0) {
+	snprintf(cpu_freq, LINE_SIZE, "%ld MHz", 100 * (long) (mhz/100.0 + 0.5));
+    }
+    if (fp != NULL)
+	fclose(fp);
+}
+
+/*
+ *  Kernels with per-thread state are sized by -m, so memsize goes into
+ *  the key.  Only the memory kernel's array uses -L, -H and -N, the
+ *  walk and stream arrays are plain allocations, so only its key has
+ *  the large mode, page mode and NUMA policy.  The walk kernel also depends on -a and -W, the
+ *  branch kernel on -b, and the recurse kernel on -D.
+ */
+static void
+kernel_key(struct prog_args *args, struct work_kernel *kern, char *buf)
+{
+    int len;
+
+    len = snprintf(buf, LINE_SIZE, "%s", kern->name);
+    if (kern->thread_init != NULL)
+	len += snprintf(buf + len, LINE_SIZE - len, "/m%d", args->memsize);
+    if (kern == &memory_kernel) {
+	if (args->large_mem)
+	    len += snprintf(buf + len, LINE_SIZE - len, "/L");
+	if (args->page_mode != 0)
+	    len += snprintf(buf + len, LINE_SIZE - len, "/H%d",
+			    args->page_mode);
+	if (args->numa_policy != NUMA_NONE)
+	    len += snprintf(buf + len, LINE_SIZE - len, "/N%d",
+			    args->numa_policy);
+    }
+    if (kern == &walk_kernel) {
+	len += snprintf(buf + len, LINE_SIZE - len, "/%s",
+			walk_pattern_name(args->walk_pattern));
+	if (args->walk_pattern == WALK_STRIDE)
+	    len += snprintf(buf + len, LINE_SIZE - len, "%d",
+			    args->walk_stride);
+	if (args->walk_kb > 0)
+	    len += snprintf(buf + len, LINE_SIZE - len, "/W%ld",
+			    args->walk_kb);
+    }
+    if (kern == &recurse_kernel)
+	len += snprintf(buf + len, LINE_SIZE - len, "/D%d", args->stack_depth);
+#ifdef __x86_64__
+    if (kern == &branch_kernel)
+	len += snprintf(buf + len, LINE_SIZE - len, "/b%d", args->branch_pct);
+#endif
+}
+
+static char *
+calib_file(void)
+{
+    static char buf[LINE_SIZE];
+    char *p;
+
+    p = getenv("PAPI_TESTS_CALIB");
+    if (p != NULL)
+	return p;
+    p = getenv("HOME");
+    if (p == NULL)
+	return NULL;
+    snprintf(buf, LINE_SIZE, "%s/.papi-tests-calib", p);
+    return buf;
+}
+
+/*
+ *  Returns: the cached scale for key, or -1 if not found.  Later
+ *  lines override earlier ones.
+ */
+static long
+read_cache(struct prog_args *args, char *key)
+{
+    char line[LINE_SIZE], *field[5], *p;
+    long scale = -1;
+    FILE *fp;
+    int n;
+
+    if (calib_file() == NULL || (fp = fopen(calib_file(), "r")) == NULL)
+	return -1;
+
+    while (fgets(line, LINE_SIZE, fp) != NULL) {
+	line[strcspn(line, "\n")] = 0;
+	p = line;
+	for (n = 0; n < 5 && p != NULL; n++) {
+	    field[n] = strsep(&p, "\t");
+	}
+	if (n == 5 && strcmp(field[0], cpu_model) == 0
+	    && strcmp(field[1], cpu_freq) == 0
+	    && strcmp(field[2], key) == 0
+	    && atoi(field[3]) == args->unit_usec) {
+	    scale = atol(field[4]);
+	}
+    }
+    fclose(fp);
+
+    return (scale > 0) ? scale : -1;
+}
+
+static void
+write_cache(struct prog_args *args, char *key, long scale)
+{
+    FILE *fp;
+
+    if (calib_file() == NULL || (fp = fopen(calib_file(), "a")) == NULL) {
+	warnx("unable to write calibration file: %s", calib_file());
+	return;
+    }
+    fprintf(fp, "%s\t%s\t%s\t%d\t%ld\n",
+	    cpu_model, cpu_freq, key, args->unit_usec, scale);
+    fclose(fp);
+}
+
+/*
+ *  Run the kernel long enough to get a good time per unit and rescale
+ *  to the target time.  Do a second pass at the new scale because the
+ *  per-unit time isn't exactly linear in the scale (cache warmup,
+ *  loop overhead).
+ */
+static long
+time_kernel(struct prog_args *args, struct work_kernel *kern)
+{
+    struct memory_state mstate;
+    struct timeval start, now;
+    double target, elapsed;
+    long scale;
+    int num, pass;
+
+    memset(&mstate, 0, sizeof(mstate));
+    mstate.seed = 1;
+    mstate.code_seed = 1;
+    if (kern->thread_init != NULL)
+	kern->thread_init(args, &mstate);
+
+    target = args->unit_usec / 1000000.0;
+    kern->run(&mstate, 1);
+
+    for (pass = 1; pass <= CALIB_PASSES; pass++) {
+	num = 1;
+	for (;;) {
+	    gettimeofday(&start, NULL);
+	    kern->run(&mstate, num);
+	    gettimeofday(&now, NULL);
+	    elapsed = time_sub(now, start);
+	    if (elapsed >= CALIB_TIME || num >= 1000000)
+		break;
+	    num = (elapsed < CALIB_TIME/20) ? 10 * num : 2 * num;
+	}
+	scale = (long) (kern->scale * target * num / elapsed + 0.5);
+	kern->scale = MAX(scale, 1);
+    }
+
+    if (kern->thread_fini != NULL)
+	kern->thread_fini(&mstate);
+
+    return kern->scale;
+}
+
+/*
+ *  Returns: 1 if the kernel's scale is calibrated to the -u time.  The
+ *  share kernels are not: their cost depends on the number of threads
+ *  and -g, so a unit timed alone on one thread is their best case and
+ *  under contention would take several times -u.  They keep the
+ *  built-in scale.
+ */
+int
+kernel_calibrated(struct prog_args *args, struct work_kernel *kern)
+{
+    return args->unit_usec > 0
+	&& kern != &share_kernel && kern != &false_share_kernel;
+}
+
+/*
+ *  Size each kernel to the -u time per unit, or leave the built-in
+ *  scales if -u 0.  Must be called before the threads start and
+ *  before PAPI_start(), so the calibration runs undisturbed.
+ */
+void
+calibrate_kernels(struct prog_args *args)
+{
+    char key[LINE_SIZE];
+    struct work_kernel *kern;
+    long scale, old_scale;
+    int k, j;
+
+    if (args->unit_usec <= 0)
+	return;
+
+    get_cpu_key();
+
+    for (k = 0; k < args->num_kernels; k++) {
+	kern = args->kernel[k];
+	for (j = 0; j < k; j++) {
+	    if (args->kernel[j] == kern)
+		break;
+	}
+	if (j < k)
+	    continue;
+
+	if (! kernel_calibrated(args, kern)) {
+	    printf("calibrate: %s, scale: %ld (built-in, depends on threads)\n",
+		   kern->name, kern->scale);
+	    continue;
+	}
+
+	kernel_key(args, kern, key);
+	scale = args->recalibrate ? -1 : read_cache(args, key);
+	if (scale > 0) {
+	    kern->scale = scale;
+	    printf("calibrate: %s, scale: %ld (cached)\n", key, scale);
+	    continue;
+	}
+
+	old_scale = kern->scale;
+	scale = time_kernel(args, kern);
+	write_cache(args, key, scale);
+	printf("calibrate: %s, scale: %ld (was %ld), %d usec per unit\n",
+	       key, scale, old_scale, args->unit_usec);
+    }
+    fflush(stdout);
+}
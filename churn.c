@@ -0,0 +1,271 @@
+/*
+ *  Thread churn test: the cost of sampling short-lived threads.
+ *
+ *  The other threaded tests create a fixed set of threads that live
+ *  for the whole run.  Here, the main thread keeps -p sampled threads
+ *  alive at once, and each one does -w units of work and exits, so
+ *  the main thread replaces about p / w threads per millisecond (with
+ *  the default calibration).  Each thread pays for:
+ *
+ *    setup     PAPI_register_thread(), event_set_for_overflow() and
+ *              PAPI_start()
+ *    teardown  PAPI_stop(), PAPI_cleanup_eventset(),
+ *              PAPI_destroy_eventset() and PAPI_unregister_thread()
+ *
+ *  The test reports percentiles of the setup and teardown latency and
+ *  of the time from PAPI_start() to the first sample.  It also counts
+ *  the samples in the first EARLY_MSEC of each thread's life against
+ *  the rate in the rest of its life, and reports the share of samples
+ *  lost at startup.
+ *
+ *  Copyright (c) 2009-2013, Rice University.
+ *  See the file LICENSE for details.
+ */
+
+#include <sys/time.h>
+#include <sys/types.h>
+#include <err.h>
+#include <error.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <papi.h>
+#include "papi-tests.h"
+
+#define DEFAULT_TIME       20
+#define DEFAULT_OVERFLOW   100000
+#define DEFAULT_LIFE       50
+#define EARLY_MSEC         10
+#define MAX_RECORDS   200000
+
+struct churn_state {
+    int tid;
+    long start;
+    long first;
+    long early;
+    long late;
+};
+
+static struct prog_args args;
+static pthread_key_t key;
+
+static struct churn_state state[MAX_THREADS];
+static struct memory_state memstate[MAX_THREADS];
+static int have_memstate[MAX_THREADS];
+
+static double SetupLat[MAX_RECORDS];
+static double TeardownLat[MAX_RECORDS];
+static double FirstLat[MAX_RECORDS];
+static volatile long num_records = 0;
+static volatile long num_first = 0;
+
+static volatile long num_done = 0;
+static volatile long tot_early = 0;
+static volatile long tot_late = 0;
+static volatile long early_ns = 0;
+static volatile long late_ns = 0;
+static volatile long no_early = 0;
+static volatile int num_errs = 0;
+
+void
+my_handler(int EventSet, void *pc, long long ovec, void *context)
+{
+    struct churn_state *st = pthread_getspecific(key);
+    long now;
+
+    if (st == NULL) {
+	return;
+    }
+    now = time_ns();
+    if (st->first == 0) {
+	st->first = now;
+    }
+    if (now - st->start < EARLY_MSEC * 1000000L)
+	st->early++;
+    else
+	st->late++;
+}
+
+void *
+churn_thread(void *data)
+{
+    struct churn_state *st = data;
+    int tid = st->tid;
+    long t0, t1, t2, t3, life;
+    int EventSet, work, n;
+
+    st->start = 0;
+    st->first = 0;
+    st->early = 0;
+    st->late = 0;
+    if (! have_memstate[tid]) {
+	memstate[tid].tid = tid;
+	init_thread_kernels(&args, &memstate[tid]);
+	have_memstate[tid] = 1;
+    }
+
+    t0 = time_ns();
+    if (PAPI_register_thread() != PAPI_OK) {
+	errx(1, "PAPI_register_thread failed");
+    }
+    EventSet = event_set_for_overflow(&args, &my_handler);
+    st->start = time_ns();
+    if (pthread_setspecific(key, st) != 0) {
+	errx(1, "pthread_setspecific failed");
+    }
+    if (PAPI_start(EventSet) != PAPI_OK) {
+	errx(1, "PAPI_start failed");
+    }
+    t1 = time_ns();
+
+    for (work = 0; work < args.work; work += kernel_work(&args, 1)) {
+	n = run_kernels(&args, &memstate[tid], 1);
+	if (n > 0) {
+	    __sync_fetch_and_add(&num_errs, n);
+	}
+    }
+
+    t2 = time_ns();
+    if (PAPI_stop(EventSet, NULL) != PAPI_OK) {
+	warnx("PAPI_stop failed");
+    }
+    pthread_setspecific(key, NULL);
+    if (PAPI_cleanup_eventset(EventSet) != PAPI_OK) {
+	warnx("PAPI_cleanup_eventset failed");
+    }
+    if (PAPI_destroy_eventset(&EventSet) != PAPI_OK) {
+	warnx("PAPI_destroy_eventset failed");
+    }
+    if (PAPI_unregister_thread() != PAPI_OK) {
+	warnx("PAPI_unregister_thread failed");
+    }
+    t3 = time_ns();
+
+    /*
+     * Early is the first EARLY_MSEC of the time from the start of the
+     * counters to the stop, late is the rest.
+     */
+    life = t2 - st->start;
+    __sync_fetch_and_add(&num_done, 1);
+    __sync_fetch_and_add(&tot_early, st->early);
+    __sync_fetch_and_add(&tot_late, st->late);
+    __sync_fetch_and_add(&early_ns, MIN(life, EARLY_MSEC * 1000000L));
+    __sync_fetch_and_add(&late_ns, MAX(life - EARLY_MSEC * 1000000L, 0));
+    if (st->early == 0) {
+	__sync_fetch_and_add(&no_early, 1);
+    }
+
+    n = __sync_fetch_and_add(&num_records, 1);
+    if (n < MAX_RECORDS) {
+	SetupLat[n] = (t1 - t0) / 1000.0;
+	TeardownLat[n] = (t3 - t2) / 1000.0;
+    }
+    if (st->first != 0) {
+	n = __sync_fetch_and_add(&num_first, 1);
+	if (n < MAX_RECORDS)
+	    FirstLat[n] = (st->first - st->start) / 1000.0;
+    }
+
+    return NULL;
+}
+
+int
+main(int argc, char **argv)
+{
+    pthread_t td[MAX_THREADS];
+    int alive[MAX_THREADS];
+    struct timeval start, last, now;
+    float secs, early_rate, late_rate;
+    long num_created, prev_done;
+    int k, opt;
+
+    set_default_args(&args);
+    args.prog_time = DEFAULT_TIME;
+    args.overflow = DEFAULT_OVERFLOW;
+    args.work = DEFAULT_LIFE;
+    opt = parse_args(&args, argc, argv);
+    get_papi_events(&args, opt, argc, argv);
+    if (args.num_events == 0) {
+	TOT_CYC_DEFAULT(args);
+    }
+    set_default_kernels(&args, 0);
+    if (args.num_threads > MAX_THREADS) {
+	errx(1, "too many threads: %d", args.num_threads);
+    }
+
+    printf("Thread Churn Test, time: %d, threads: %d, life: %d units, ",
+	   args.prog_time, args.num_threads, args.work);
+    print_event_list(&args);
+    print_kernel_list(&args);
+    init_kernels(&args);
+
+    if (PAPI_thread_init(pthread_self) != PAPI_OK) {
+	errx(1, "PAPI_thread_init failed");
+    }
+    if (pthread_key_create(&key, NULL) != 0) {
+	errx(1, "pthread key create failed");
+    }
+    for (k = 0; k < args.num_threads; k++) {
+	state[k].tid = k;
+	alive[k] = 0;
+    }
+
+    /*
+     * Keep num_threads threads alive, replace each one as it exits.
+     * The threads live about the same time, so join in round robin.
+     */
+    gettimeofday(&start, NULL);
+    last = start;
+    prev_done = 0;
+    num_created = 0;
+    for (;;) {
+	k = num_created % args.num_threads;
+	if (alive[k]) {
+	    pthread_join(td[k], NULL);
+	    alive[k] = 0;
+	}
+	gettimeofday(&now, NULL);
+	if (time_sub(now, last) >= 1.0) {
+	    printf("time: %.1f, threads: %ld, per sec: %.1f\n",
+		   time_sub(now, start), num_done,
+		   (num_done - prev_done) / time_sub(now, last));
+	    prev_done = num_done;
+	    last = now;
+	}
+	if (time_sub(now, start) >= (float) args.prog_time) {
+	    break;
+	}
+	if (pthread_create(&td[k], NULL, churn_thread, &state[k]) != 0) {
+	    errx(1, "pthread create failed");
+	}
+	alive[k] = 1;
+	num_created++;
+    }
+    for (k = 0; k < args.num_threads; k++) {
+	if (alive[k])
+	    pthread_join(td[k], NULL);
+    }
+    gettimeofday(&now, NULL);
+    secs = time_sub(now, start);
+
+    printf("\nThread Churn Test, threads: %ld, per sec: %.1f, samples: %ld\n\n",
+	   num_done, num_done / secs, tot_early + tot_late);
+    printf("%-14s  %8s  %8s  %8s  %8s  %8s  %8s\n", "latency (usec)",
+	   "count", "min", "p50", "p90", "p99", "max");
+    print_latency("setup", SetupLat, MIN(num_records, MAX_RECORDS));
+    print_latency("teardown", TeardownLat, MIN(num_records, MAX_RECORDS));
+    print_latency("first sample", FirstLat, MIN(num_first, MAX_RECORDS));
+
+    early_rate = tot_early / (MAX(early_ns, 1) / 1.0e9);
+    late_rate = tot_late / (MAX(late_ns, 1) / 1.0e9);
+    printf("\nfirst %d msec: %.1f samples/sec, rest of life: %.1f samples/sec\n",
+	   EARLY_MSEC, early_rate, late_rate);
+    printf("lost at startup: %.1f%%, threads with no early samples: %ld\n\n",
+	   (late_rate > 0.0) ? MAX(100.0 * (1.0 - early_rate / late_rate), 0.0)
+	   : 0.0, no_early);
+
+    EXIT_PASS_FAIL(num_done > 0 && num_errs == 0);
+}
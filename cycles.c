@@ -11,20 +11,33 @@
  */
 
 #include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/types.h>
 #include <err.h>
 #include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "papi-tests.h"
 
+#ifdef __x86_64__
+#include <emmintrin.h>
+#endif
+
+static struct work_kernel flops_kernel;
+
 /*
  *  Floating point add, sub, mult, divide, some branch instructions.
  *
  *  These tests are tuned to take approx 1 sec for num = 1000 on my
- *  main test machine (2.25 GHz Intel Xeon 5520).  YMMV a lot.
+ *  main test machine (2.25 GHz Intel Xeon 5520).  YMMV a lot.  The
+ *  scales are the defaults, calibrate_kernels() resizes them to the
+ *  -u time per unit of work.
  */
 #define FLOPS_SCALE  78000
-int
-run_flops(int num)
+static int
+flops_run(struct memory_state *mstate, int num)
 {
     double y, z, sum;
     int k, x, num_errs;
@@ -35,7 +48,7 @@ run_flops(int num)
 	y = 0.0;
 	sum = 0.0;
 	seed = 1;
-	for (x = 1; x < FLOPS_SCALE; x++) {
+	for (x = 1; x < flops_kernel.scale; x++) {
 	    y += 1.0;
 	    z = y * y;
 	    seed = random_gen(seed);
@@ -54,36 +67,267 @@ run_flops(int num)
     return (num_errs);
 }
 
+/*
+ *  Fill addr[lo, hi) with addr[k] = k.  With stream, use non-temporal
+ *  stores (x86-64 only) so the fill doesn't evict the rest of the
+ *  cache, four ints at a time from a 16-byte aligned index.
+ */
+struct fill_range {
+    int *addr;
+    long lo;
+    long hi;
+    int stream;
+};
+
+static void *
+fill_memory(void *data)
+{
+    struct fill_range *range = data;
+    int *addr = range->addr;
+    long k = range->lo;
+
+#ifdef __x86_64__
+    __m128i val, four;
+
+    if (range->stream) {
+	for (; k < range->hi && k % 4 != 0; k++) {
+	    addr[k] = k;
+	}
+	val = _mm_set_epi32(k + 3, k + 2, k + 1, k);
+	four = _mm_set1_epi32(4);
+	for (; k + 4 <= range->hi; k += 4) {
+	    _mm_stream_si128((__m128i *) &addr[k], val);
+	    val = _mm_add_epi32(val, four);
+	}
+	_mm_sfence();
+    }
+#endif
+    for (; k < range->hi; k++) {
+	addr[k] = k;
+    }
+
+    return NULL;
+}
+
+/*
+ *  Split the fill into init_threads chunks, one per thread, with the
+ *  calling thread doing the first chunk.  Falls back to a serial fill
+ *  if pthread_create() fails.
+ */
+static void
+parallel_fill(struct memory_state *mstate, int init_threads, int stream)
+{
+    struct fill_range range[MAX_INIT_THREADS];
+    pthread_t td[MAX_INIT_THREADS];
+    int started[MAX_INIT_THREADS];
+    long chunk;
+    int k;
+
+    init_threads = MAX(1, MIN(init_threads, MAX_INIT_THREADS));
+    chunk = (mstate->size + init_threads - 1) / init_threads;
+    chunk = (chunk + 1023) & ~1023L;
+
+    for (k = 0; k < init_threads; k++) {
+	range[k].addr = mstate->addr;
+	range[k].lo = MIN(k * chunk, mstate->size);
+	range[k].hi = MIN((k + 1) * chunk, mstate->size);
+	range[k].stream = stream;
+	started[k] = 0;
+    }
+    for (k = 1; k < init_threads; k++) {
+	if (range[k].lo < range[k].hi
+	    && pthread_create(&td[k], NULL, fill_memory, &range[k]) == 0) {
+	    started[k] = 1;
+	}
+    }
+    fill_memory(&range[0]);
+    for (k = 1; k < init_threads; k++) {
+	if (started[k])
+	    pthread_join(td[k], NULL);
+	else
+	    fill_memory(&range[k]);
+    }
+}
+
 /*
  *  MMap() an array of memsize Meg and initialize it.
  *  We maintain the invariant addr[k] = k.
+ *
+ *  The page mode (-H) selects explicit huge pages (MAP_HUGETLB),
+ *  transparent huge pages (madvise) on or off, pre-populated and/or
+ *  mlocked mappings.  THP needs a huge page aligned range, so we map
+ *  an extra huge page and align the array inside the mapping.  The
+ *  NUMA policy (-N) is applied before the first touch, see numa.c.
+ *
+ *  With -I, the fill is split over several threads and may use
+ *  non-temporal stores.  Without -N, the first touch from the helper
+ *  threads decides the placement, so the pages may be spread over
+ *  several nodes.  The time for the mmap and fill goes in init_secs.
  */
 #define MEG  (1024 * 1024)
+#define HUGE_ALIGN  (2 * MEG)
 void
-init_memory(struct memory_state *mstate, int memsize)
+init_memory(struct memory_state *mstate, struct prog_args *args)
 {
-    int k, flags;
+    struct timeval start, end;
+    int memsize = args->memsize;
+    int page_mode = args->page_mode;
+    long huge_bytes;
+    size_t align;
+    char *base;
+    int flags;
 
     mstate->addr = NULL;
-    mstate->bytes = memsize * MEG;
+    mstate->map_addr = NULL;
+    mstate->bytes = (size_t) memsize * MEG;
     mstate->size = mstate->bytes / sizeof(mstate->addr[0]);
     mstate->seed = 1;
+    mstate->seed64 = 1;
+    mstate->page_kb = 0;
+    mstate->huge_kb = 0;
+    mstate->local_pct = -1.0;
+    mstate->init_secs = 0.0;
+    mstate->large = args->large_mem;
     if (memsize == 0)
 	return;
 
+    gettimeofday(&start, NULL);
+
 #ifdef MAP_ANONYMOUS
     flags = MAP_PRIVATE | MAP_ANONYMOUS;
 #else
     flags = MAP_PRIVATE | MAP_ANON;
 #endif
-    mstate->addr = mmap(NULL, mstate->bytes, PROT_READ | PROT_WRITE,
-			flags, -1, 0);
-    if (mstate->addr == MAP_FAILED) {
+    mstate->map_bytes = mstate->bytes;
+    align = 0;
+
+    if (page_mode & PAGE_HUGETLB) {
+#ifdef MAP_HUGETLB
+	huge_bytes = 1024 * huge_page_kb();
+	flags |= MAP_HUGETLB;
+	mstate->map_bytes = (mstate->bytes + huge_bytes - 1)
+	    / huge_bytes * huge_bytes;
+#else
+	errx(1, "%s: MAP_HUGETLB is not supported on this system", __func__);
+#endif
+    }
+    else if (page_mode & PAGE_THP) {
+	align = HUGE_ALIGN;
+	mstate->map_bytes = mstate->bytes + align;
+    }
+#ifdef MAP_POPULATE
+    if (page_mode & PAGE_POPULATE)
+	flags |= MAP_POPULATE;
+#endif
+
+    mstate->map_addr = mmap(NULL, mstate->map_bytes, PROT_READ | PROT_WRITE,
+			    flags, -1, 0);
+    if (mstate->map_addr == MAP_FAILED) {
+	if (page_mode & PAGE_HUGETLB)
+	    errx(1, "%s: mmap(%d meg, MAP_HUGETLB) failed, check "
+		 "/proc/sys/vm/nr_hugepages", __func__, memsize);
 	errx(1, "%s: mmap(%d meg) failed", __func__, memsize);
     }
-    for (k = 0; k < mstate->size; k++) {
-	mstate->addr[k] = k;
+    base = mstate->map_addr;
+    if (align > 0)
+	base = (char *) (((unsigned long) base + align - 1) & ~(align - 1));
+    mstate->addr = (int *) base;
+
+#ifdef MADV_HUGEPAGE
+    if ((page_mode & PAGE_THP)
+	&& madvise(mstate->addr, mstate->bytes, MADV_HUGEPAGE) != 0) {
+	warn("%s: madvise(MADV_HUGEPAGE) failed", __func__);
+    }
+    if ((page_mode & PAGE_NOTHP)
+	&& madvise(mstate->addr, mstate->bytes, MADV_NOHUGEPAGE) != 0) {
+	warn("%s: madvise(MADV_NOHUGEPAGE) failed", __func__);
+    }
+#else
+    if (page_mode & (PAGE_THP | PAGE_NOTHP))
+	warnx("%s: madvise huge pages is not supported on this system",
+	      __func__);
+#endif
+    numa_bind_memory(mstate, args->numa_policy);
+
+    parallel_fill(mstate, args->init_threads, args->init_stream);
+
+    if ((page_mode & PAGE_LOCK)
+	&& mlock(mstate->addr, mstate->bytes) != 0) {
+	warn("%s: mlock(%d meg) failed, check ulimit -l", __func__, memsize);
+    }
+    gettimeofday(&end, NULL);
+    mstate->init_secs = time_sub(end, start);
+
+    get_page_info(mstate);
+    numa_locality(mstate);
+}
+
+void
+free_memory(struct memory_state *mstate)
+{
+    if (mstate->map_addr != NULL) {
+	munmap(mstate->map_addr, mstate->map_bytes);
+	mstate->map_addr = NULL;
+	mstate->addr = NULL;
+    }
+}
+
+/*
+ *  Large memory mode (-L) for arrays past 2000 meg.  random_gen() has
+ *  period PRIME (about 10 million), so on a big array it only ever
+ *  touches 10 million slots.  Instead, use 64-bit indices from
+ *  xorshift_gen() (period 2^64 - 1), and since addr[k] holds k mod
+ *  2^32 past 8 gig, check the sum in unsigned 32-bit arithmetic.
+ *  The xorshift state lives in seed64, since seed is shared with the
+ *  random_gen() kernels (walk, etc) and must stay below PRIME.
+ */
+static int
+run_memory_large(struct memory_state *mstate, int work)
+{
+    unsigned long seed, size;
+    unsigned int sum;
+    long r1, r2, r3, r4, w1, w2, w3, w4;
+    long k;
+
+    seed = (mstate->seed64 != 0) ? mstate->seed64 : 1;
+    size = mstate->size;
+
+    for (k = 1; k <= work * memory_kernel.scale; k++)
+    {
+	seed = xorshift_gen(seed);
+	r1 = seed % size;
+	seed = xorshift_gen(seed);
+	r2 = seed % size;
+	seed = xorshift_gen(seed);
+	r3 = seed % size;
+	seed = xorshift_gen(seed);
+	r4 = seed % size;
+	seed = xorshift_gen(seed);
+	w1 = seed % size;
+	seed = xorshift_gen(seed);
+	w2 = seed % size;
+	seed = xorshift_gen(seed);
+	w3 = seed % size;
+	seed = xorshift_gen(seed);
+	w4 = seed % size;
+
+	/* Launch four reads and four writes. */
+	sum = (unsigned int) mstate->addr[r1]
+	    + (unsigned int) mstate->addr[r2]
+	    + (unsigned int) mstate->addr[r3]
+	    + (unsigned int) mstate->addr[r4];
+	mstate->addr[w1] = (int) w1;
+	mstate->addr[w2] = (int) w2;
+	mstate->addr[w3] = (int) w3;
+	mstate->addr[w4] = (int) w4;
+
+	if (sum != (unsigned int) (r1 + r2 + r3 + r4)) {
+	    errx(1, "%s: memory corruption near index %ld", __func__, r1);
+	}
     }
+    mstate->seed64 = seed;
+
+    return 0;
 }
 
 /*
@@ -95,12 +339,15 @@ int
 run_memory(struct memory_state *mstate, int work)
 {
     int r1, r2, r3, r4, w1, w2, w3, w4;
-    int k, sum;
+    int sum;
+    long k;
 
     if (mstate->addr == NULL)
 	return 1;
+    if (mstate->large)
+	return run_memory_large(mstate, work);
 
-    for (k = 1; k <= work * MEM_SCALE; k++)
+    for (k = 1; k <= work * memory_kernel.scale; k++)
     {
 	mstate->seed = random_gen(mstate->seed);
 	r1 = mstate->seed % mstate->size;
@@ -136,3 +383,362 @@ run_memory(struct memory_state *mstate, int work)
 
     return 0;
 }
+
+/*
+ *  The flops loop lives in the kernel's run function so that profile
+ *  can attribute its samples there.
+ */
+int
+run_flops(int num)
+{
+    return flops_run(NULL, num);
+}
+
+static void
+memory_thread_init(struct prog_args *args, struct memory_state *mstate)
+{
+    if (args->memsize == 0) {
+	errx(1, "the memory kernel requires memsize (-m) > 0");
+    }
+    init_memory(mstate, args);
+}
+
+static struct work_kernel flops_kernel = {
+    "flops", "scalar FP add, mult, divide and branches",
+    "PAPI_TOT_CYC PAPI_FP_INS PAPI_FP_OPS PAPI_BR_INS",
+    NULL, NULL, NULL, flops_run, FLOPS_SCALE, 0, 0, 0, 0, 0,
+};
+
+struct work_kernel memory_kernel = {
+    "memory", "random reads and writes over the -m array",
+    "PAPI_L1_DCM PAPI_L2_TCM PAPI_L3_TCM PAPI_TLB_DM",
+    NULL, memory_thread_init, free_memory, run_memory,
+    MEM_SCALE, 0, 0, 0, 0, 0,
+};
+
+/*
+ *  Registry of workload kernels.  The test programs run a weighted
+ *  mix of kernels selected with -k, instead of calling run_flops()
+ *  and run_memory() directly.
+ */
+static struct work_kernel *kernel_table[] = {
+    &flops_kernel,
+    &memory_kernel,
+    &walk_kernel,
+    &stream_copy_kernel,
+    &stream_scale_kernel,
+    &stream_add_kernel,
+    &stream_triad_kernel,
+    &share_kernel,
+    &false_share_kernel,
+    &recurse_kernel,
+#ifdef __x86_64__
+    &branch_kernel,
+    &icache_kernel,
+    &exact_kernel,
+    &sse_dp_kernel,
+    &sse_sp_kernel,
+    &avx_dp_kernel,
+    &avx_sp_kernel,
+    &avx512_dp_kernel,
+    &avx512_sp_kernel,
+#endif
+    NULL
+};
+
+struct work_kernel *
+find_kernel(char *name)
+{
+    int k;
+
+#ifdef __x86_64__
+    if (strcmp(name, "vector") == 0)
+	return best_vector_kernel();
+#endif
+    for (k = 0; kernel_table[k] != NULL; k++) {
+	if (strcmp(name, kernel_table[k]->name) == 0)
+	    return kernel_table[k];
+    }
+    return NULL;
+}
+
+/*
+ *  Add all four stream kernels with the same weight, for 'stream'.
+ */
+static void
+add_stream_kernels(struct prog_args *args, int weight)
+{
+    struct work_kernel *kern[] = {
+	&stream_copy_kernel, &stream_scale_kernel,
+	&stream_add_kernel, &stream_triad_kernel,
+    };
+    int k;
+
+    for (k = 0; k < 4; k++) {
+	if (args->num_kernels >= MAX_KERNELS) {
+	    errx(1, "too many kernels: %d", args->num_kernels);
+	}
+	args->kernel[args->num_kernels] = kern[k];
+	args->weight[args->num_kernels] = weight;
+	args->num_kernels++;
+    }
+}
+
+/*
+ *  Add kernels from a spec of the form: NAME[:WEIGHT],...
+ *  As with events, the delimiter may be colon (:) or at-sign (@).
+ */
+void
+add_kernels(struct prog_args *args, char *spec)
+{
+    char *buf, *name, *colon, *save;
+    int n, ret;
+
+    buf = strdup(spec);
+    for (name = strtok_r(buf, ",", &save); name != NULL;
+	 name = strtok_r(NULL, ",", &save))
+    {
+	n = args->num_kernels;
+	if (n >= MAX_KERNELS) {
+	    errx(1, "too many kernels: %d", n);
+	}
+	args->weight[n] = 1;
+	colon = strpbrk(name, ":@");
+	if (colon != NULL) {
+	    *colon = 0;
+	    ret = sscanf(colon + 1, "%d", &args->weight[n]);
+	    if (ret < 1 || args->weight[n] < 1) {
+		errx(1, "invalid weight for kernel %s: %s", name, colon + 1);
+	    }
+	}
+	if (strcmp(name, "stream") == 0) {
+	    add_stream_kernels(args, args->weight[n]);
+	    continue;
+	}
+	args->kernel[n] = find_kernel(name);
+	if (args->kernel[n] == NULL) {
+	    errx(1, "unknown kernel: %s (see -h for the list)", name);
+	}
+	args->num_kernels++;
+    }
+    free(buf);
+}
+
+/*
+ *  If no kernels were given with -k, then use the traditional mix of
+ *  flops plus memory (if memsize > 0).
+ */
+void
+set_default_kernels(struct prog_args *args, int use_memory)
+{
+    if (args->num_kernels > 0)
+	return;
+
+    add_kernels(args, "flops");
+    if (use_memory && args->memsize > 0) {
+	add_kernels(args, "memory");
+    }
+}
+
+void
+list_kernels(void)
+{
+    int k;
+
+    printf("\nKernels for -k (name, description, events it is meant to trigger):\n");
+    for (k = 0; kernel_table[k] != NULL; k++) {
+	printf("  %-10s %s\n  %-10s (%s)\n", kernel_table[k]->name,
+	       kernel_table[k]->desc, "", kernel_table[k]->events);
+    }
+    printf("  %-10s stream-copy, -scale, -add and -triad\n", "stream");
+#ifdef __x86_64__
+    printf("  %-10s the widest of the -dp kernels this CPU supports\n",
+	   "vector");
+#endif
+}
+
+void
+print_kernel_list(struct prog_args *args)
+{
+    int k;
+
+    printf("kernels: ");
+    for (k = 0; k < args->num_kernels; k++) {
+	printf("%s@%d", args->kernel[k]->name, args->weight[k]);
+	if (args->unit_usec > 0 && ! kernel_calibrated(args, args->kernel[k]))
+	    printf(" (built-in scale)");
+	if (k < args->num_kernels - 1)
+	    printf("  ");
+    }
+    if (args->unit_usec > 0) {
+	printf(", unit of work: %d usec", args->unit_usec);
+    }
+    printf("\n");
+}
+
+/*
+ *  Call init() once per process for each distinct kernel, and then
+ *  size the kernels to the -u time per unit of work.
+ */
+void
+init_kernels(struct prog_args *args)
+{
+    int k, j;
+
+    for (k = 0; k < args->num_kernels; k++) {
+	for (j = 0; j < k; j++) {
+	    if (args->kernel[j] == args->kernel[k])
+		break;
+	}
+	if (j == k && args->kernel[k]->init != NULL) {
+	    args->kernel[k]->init(args);
+	}
+    }
+    calibrate_kernels(args);
+}
+
+/*
+ *  Call thread_init() once per memory state (thread) for each
+ *  distinct kernel.  The caller sets mstate->tid for threaded tests.
+ */
+void
+init_thread_kernels(struct prog_args *args, struct memory_state *mstate)
+{
+    int k, j;
+
+    mstate->addr = NULL;
+    mstate->walk_lines = NULL;
+    mstate->stream_a = NULL;
+    mstate->seed = 1;
+    mstate->seed64 = 1;
+    mstate->code_seed = 1;
+    for (k = 0; k < args->num_kernels; k++) {
+	for (j = 0; j < k; j++) {
+	    if (args->kernel[j] == args->kernel[k])
+		break;
+	}
+	if (j == k && args->kernel[k]->thread_init != NULL) {
+	    args->kernel[k]->thread_init(args, mstate);
+	}
+    }
+}
+
+/*
+ *  Run num units of each kernel times its weight.  Returns the number
+ *  of errors, the amount of work is kernel_work(args, num).
+ */
+int
+run_kernels(struct prog_args *args, struct memory_state *mstate, int num)
+{
+    int k, num_errs;
+
+    num_errs = 0;
+    for (k = 0; k < args->num_kernels; k++) {
+	num_errs += args->kernel[k]->run(mstate, num * args->weight[k]);
+    }
+    return num_errs;
+}
+
+int
+kernel_work(struct prog_args *args, int num)
+{
+    int k, total;
+
+    total = 0;
+    for (k = 0; k < args->num_kernels; k++) {
+	total += num * args->weight[k];
+    }
+    return total;
+}
+
+/*
+ *  Convert work units to seconds, or 0.0 if not calibrated, or if any
+ *  kernel in the mix keeps its built-in scale.
+ */
+float
+work_secs(struct prog_args *args, long work)
+{
+    int k;
+
+    for (k = 0; k < args->num_kernels; k++) {
+	if (! kernel_calibrated(args, args->kernel[k]))
+	    return 0.0;
+    }
+    return ((float) args->unit_usec) * ((float) work) / 1000000.0;
+}
+
+/*
+ *  Format work units for the progress lines: "N (secs)", or just "N"
+ *  if work_secs() can't say.  Returns: buf.
+ */
+char *
+work_str(struct prog_args *args, long work, char *buf, size_t size)
+{
+    float secs = work_secs(args, work);
+
+    if (secs > 0.0)
+	snprintf(buf, size, "%ld (%.2fs)", work, secs);
+    else
+	snprintf(buf, size, "%ld", work);
+    return buf;
+}
+
+/*
+ *  Returns: the expected number of events for work units of the -k
+ *  mix, if every kernel in the mix has a known count for this event,
+ *  else -1.0.
+ */
+double
+expected_events(struct prog_args *args, char *event, long work)
+{
+    struct work_kernel *kern;
+    double total;
+    long per_iter;
+    int k;
+
+    total = 0.0;
+    for (k = 0; k < args->num_kernels; k++) {
+	kern = args->kernel[k];
+	if (strcmp(event, "PAPI_TOT_INS") == 0)
+	    per_iter = kern->ins;
+	else if (strcmp(event, "PAPI_BR_INS") == 0
+		 || strcmp(event, "PAPI_BR_CN") == 0)
+	    per_iter = kern->br;
+	else if (strcmp(event, "PAPI_FP_INS") == 0)
+	    per_iter = kern->fp_ins;
+	else if (strcmp(event, "PAPI_FP_OPS") == 0)
+	    per_iter = kern->fp_ops;
+	else
+	    per_iter = 0;
+
+	if (per_iter <= 0)
+	    return -1.0;
+	total += (double) args->weight[k] * kern->scale * per_iter;
+    }
+    if (args->num_kernels == 0)
+	return -1.0;
+
+    return total * work / (double) kernel_work(args, 1);
+}
+
+/*
+ *  Returns: the number of bytes moved by work units of the -k mix, or
+ *  0.0 if no kernel in the mix has a known byte count.  Kernels with
+ *  no count add nothing, so this is a lower bound for mixed runs.
+ */
+double
+work_bytes(struct prog_args *args, long work)
+{
+    double total;
+    int k;
+
+    total = 0.0;
+    for (k = 0; k < args->num_kernels; k++) {
+	total += (double) args->weight[k] * args->kernel[k]->scale
+	    * args->kernel[k]->bytes;
+    }
+    if (total <= 0.0)
+	return 0.0;
+
+    return total * work / (double) kernel_work(args, 1);
+}
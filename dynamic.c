@@ -0,0 +1,338 @@
+/*
+ *  Threads stress test with dynamic scheduling.
+ *
+ *  threads gives each pthread an equal, fixed share of the work, which
+ *  is the easiest case for an even spread of samples.  Here, the work
+ *  runs in rounds, like the parallel loops of an OpenMP program with
+ *  schedule(dynamic, 1): each round is TASKS_PER_THREAD tasks per
+ *  thread of random size (1 to 2w-1 units, average -w), and the
+ *  threads take the next task from a shared counter until there are
+ *  none left.  So, tasks move between threads from one round to the
+ *  next.
+ *
+ *  At the end of each round, a thread with no more tasks spins for up
+ *  to SPIN_USEC waiting for the others, as the OpenMP runtimes do,
+ *  and then sleeps in a futex barrier.  Samples that land in the spin
+ *  are runtime overhead, not work.
+ *
+ *  The first half of the run has no interrupts and sets the base rate
+ *  of work, the second half samples with the overflow event.  The test
+ *  reports the overhead, the spread of interrupts per unit of work
+ *  over the threads, the share of tasks run off their home thread
+ *  (task index mod threads) and the time and samples in the spin.
+ *
+ *  Copyright (c) 2009-2013, Rice University.
+ *  See the file LICENSE for details.
+ */
+
+#include <sys/time.h>
+#include <sys/types.h>
+#include <err.h>
+#include <error.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <papi.h>
+#include "papi-tests.h"
+
+#define DEFAULT_TIME        20
+#define DEFAULT_TASK_UNITS   4
+#define TASKS_PER_THREAD     4
+#define MAX_TASKS   (TASKS_PER_THREAD * MAX_THREADS)
+#define SPIN_USEC          200
+#define MAX_SPREAD        50.0
+
+enum { BASE = 0, SAMPLE, DONE };
+
+static struct prog_args args;
+static pthread_key_t key;
+
+static int EventSet[MAX_THREADS];
+static struct memory_state memstate[MAX_THREADS];
+
+static struct barrier round_barrier;
+static volatile int phase = BASE;
+
+static int Task[MAX_TASKS];
+static int num_tasks;
+static volatile int next_task;
+static volatile int finished;
+
+static volatile long count[MAX_THREADS];
+static volatile long spin_count[MAX_THREADS];
+static volatile int in_spin[MAX_THREADS];
+
+static long work[MAX_THREADS];
+static long tasks[MAX_THREADS];
+static long migrated[MAX_THREADS];
+static long spin_ns[MAX_THREADS];
+static long base_work[MAX_THREADS];
+static int num_errs[MAX_THREADS];
+
+void
+my_handler(int EventSet, void *pc, long long ovec, void *context)
+{
+    int tid = *(int *)pthread_getspecific(key);
+
+    if (tid < 0 || tid >= args.num_threads) {
+	warnx("thread id from getspecific out of bounds: %d", tid);
+	return;
+    }
+    count[tid]++;
+    if (in_spin[tid])
+	spin_count[tid]++;
+}
+
+/*
+ *  Take tasks from the shared counter until there are none left, then
+ *  spin for the other threads, like the OpenMP runtime's barrier.
+ */
+void
+run_round(int tid)
+{
+    long start;
+    int t;
+
+    for (;;) {
+	t = __sync_fetch_and_add(&next_task, 1);
+	if (t >= num_tasks)
+	    break;
+	num_errs[tid] += run_kernels(&args, &memstate[tid], Task[t]);
+	work[tid] += kernel_work(&args, Task[t]);
+	tasks[tid]++;
+	if (t % args.num_threads != tid)
+	    migrated[tid]++;
+    }
+    topology_check_cpu(tid);
+
+    in_spin[tid] = 1;
+    start = time_ns();
+    __sync_fetch_and_add(&finished, 1);
+    while (finished < args.num_threads
+	   && time_ns() - start < SPIN_USEC * 1000L) {
+	;
+    }
+    spin_ns[tid] += time_ns() - start;
+    in_spin[tid] = 0;
+}
+
+void *
+my_thread(void *data)
+{
+    int tid = *(int *)data;
+    int started = 0;
+
+    if (pthread_setspecific(key, data) != 0)
+	errx(1, "pthread_setspecific failed");
+
+    topology_pin(tid);
+    EventSet[tid] = event_set_for_overflow(&args, &my_handler);
+    memstate[tid].tid = tid;
+    init_thread_kernels(&args, &memstate[tid]);
+
+    /* Thread zero sets up each round between the two barriers. */
+    for (;;) {
+	barrier_wait(&round_barrier);
+	if (phase == DONE)
+	    break;
+	if (phase == SAMPLE && ! started) {
+	    if (PAPI_start(EventSet[tid]) != PAPI_OK)
+		errx(1, "PAPI_start failed");
+	    started = 1;
+	}
+	run_round(tid);
+	barrier_wait(&round_barrier);
+    }
+
+    if (started)
+	PAPI_stop(EventSet[tid], NULL);
+    return NULL;
+}
+
+/*
+ *  Thread zero: run rounds of random sized tasks, base phase for the
+ *  first half of the time, sampling for the second half.  Returns the
+ *  elapsed time of each phase in secs[].
+ */
+void
+thread_zero(int *data, float *secs)
+{
+    struct timeval start, switch_time, last, now;
+    unsigned int seed = 1;
+    long total, prev, sum;
+    int k, rounds;
+
+    if (pthread_setspecific(key, data) != 0)
+	errx(1, "pthread_setspecific failed");
+    topology_pin(0);
+    EventSet[0] = event_set_for_overflow(&args, &my_handler);
+    memstate[0].tid = 0;
+    init_thread_kernels(&args, &memstate[0]);
+
+    num_tasks = TASKS_PER_THREAD * args.num_threads;
+    gettimeofday(&start, NULL);
+    switch_time = start;
+    last = start;
+    prev = 0;
+    rounds = 0;
+    for (;;) {
+	gettimeofday(&now, NULL);
+	if (phase == BASE && time_sub(now, start) >= 0.5 * args.prog_time) {
+	    for (k = 0; k < args.num_threads; k++) {
+		base_work[k] = work[k];
+		tasks[k] = 0;
+		migrated[k] = 0;
+		spin_ns[k] = 0;
+	    }
+	    secs[BASE] = time_sub(now, start);
+	    switch_time = now;
+	    phase = SAMPLE;
+	    if (PAPI_start(EventSet[0]) != PAPI_OK)
+		errx(1, "PAPI_start failed");
+	}
+	else if (phase == SAMPLE && time_sub(now, start) >= args.prog_time) {
+	    secs[SAMPLE] = time_sub(now, switch_time);
+	    phase = DONE;
+	    barrier_wait(&round_barrier);
+	    PAPI_stop(EventSet[0], NULL);
+	    break;
+	}
+	if (time_sub(now, last) >= 1.0) {
+	    total = 0;
+	    sum = 0;
+	    for (k = 0; k < args.num_threads; k++) {
+		total += work[k];
+		sum += count[k];
+	    }
+	    printf("time: %.1f, %s, rounds: %d, work/sec: %.1f, intr: %ld\n",
+		   time_sub(now, start), (phase == BASE) ? "base" : "sample",
+		   rounds, (total - prev) / time_sub(now, last), sum);
+	    prev = total;
+	    last = now;
+	}
+
+	for (k = 0; k < num_tasks; k++) {
+	    Task[k] = 1 + rand_r(&seed) % (2 * args.work - 1);
+	}
+	next_task = 0;
+	finished = 0;
+
+	barrier_wait(&round_barrier);
+	run_round(0);
+	barrier_wait(&round_barrier);
+	rounds++;
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    pthread_t td[MAX_THREADS];
+    int tid[MAX_THREADS];
+    float secs[2], base_rate, rate, ipw, min_ipw, max_ipw, avg_ipw;
+    long tot_work, tot_count, tot_spin, tot_spin_count, tot_tasks, tot_mig;
+    int k, opt, errs;
+
+    set_default_args(&args);
+    args.prog_time = DEFAULT_TIME;
+    args.work = DEFAULT_TASK_UNITS;
+    opt = parse_args(&args, argc, argv);
+    get_papi_events(&args, opt, argc, argv);
+    if (args.num_events == 0) {
+	TOT_CYC_DEFAULT(args);
+    }
+    set_default_kernels(&args, 0);
+    if (args.num_threads > MAX_THREADS) {
+	errx(1, "too many threads: %d", args.num_threads);
+    }
+
+    printf("Dynamic Schedule Test, time: %d, threads: %d, tasks/round: %d, "
+	   "task: %d units avg\n", args.prog_time, args.num_threads,
+	   TASKS_PER_THREAD * args.num_threads, args.work);
+    print_event_list(&args);
+    print_kernel_list(&args);
+    init_kernels(&args);
+    topology_init(&args);
+
+    if (PAPI_thread_init(pthread_self) != PAPI_OK) {
+	errx(1, "PAPI_thread_init failed");
+    }
+    if (pthread_key_create(&key, NULL) != 0) {
+	errx(1, "pthread key create failed");
+    }
+    barrier_init(&round_barrier, args.num_threads);
+
+    for (k = 0; k < args.num_threads; k++) {
+	tid[k] = k;
+    }
+    for (k = 1; k < args.num_threads; k++) {
+	if (pthread_create(&td[k], NULL, my_thread, &tid[k]) != 0)
+	    errx(1, "pthread create failed");
+    }
+    thread_zero(&tid[0], secs);
+    for (k = 1; k < args.num_threads; k++) {
+	pthread_join(td[k], NULL);
+    }
+
+    /*
+     * Interrupts per unit of work are over the sampling phase only,
+     * the count is zero in the base phase.
+     */
+    printf("\nDynamic Schedule Test, threads: %d\n\n", args.num_threads);
+    printf("%4s  %8s  %8s  %10s  %8s  %10s  %10s  %10s  %4s  %6s\n",
+	   "tid", "tasks", "migr %", "work", "intr", "intr/Kwork",
+	   "spin msec", "spin intr%", "cpu", "moves");
+
+    tot_work = 0;
+    tot_count = 0;
+    tot_spin = 0;
+    tot_spin_count = 0;
+    tot_tasks = 0;
+    tot_mig = 0;
+    min_ipw = 1.0e30;
+    max_ipw = 0.0;
+    errs = 0;
+    for (k = 0; k < args.num_threads; k++) {
+	ipw = 1000.0 * count[k] / (float) MAX(work[k] - base_work[k], 1);
+	min_ipw = MIN(min_ipw, ipw);
+	max_ipw = MAX(max_ipw, ipw);
+	printf("%4d  %8ld  %8.1f  %10ld  %8ld  %10.2f  %10.1f  %10.1f  %4d  %6ld\n",
+	       k, tasks[k], 100.0 * migrated[k] / (float) MAX(tasks[k], 1),
+	       work[k] - base_work[k], count[k], ipw, spin_ns[k] / 1.0e6,
+	       100.0 * spin_count[k] / (float) MAX(count[k], 1),
+	       topology_last_cpu(k), topology_moves(k));
+	tot_work += work[k] - base_work[k];
+	tot_count += count[k];
+	tot_spin += spin_ns[k];
+	tot_spin_count += spin_count[k];
+	tot_tasks += tasks[k];
+	tot_mig += migrated[k];
+	errs += num_errs[k];
+    }
+
+    base_rate = 0.0;
+    for (k = 0; k < args.num_threads; k++) {
+	base_rate += base_work[k];
+    }
+    base_rate /= MAX(secs[BASE], 0.001);
+    rate = tot_work / MAX(secs[SAMPLE], 0.001);
+    avg_ipw = 1000.0 * tot_count / (float) MAX(tot_work, 1);
+
+    printf("\nwork/sec: base: %.1f, sampling: %.1f, overhead: %.1f%%\n",
+	   base_rate, rate, 100.0 * (1.0 - rate / MAX(base_rate, 1.0)));
+    printf("intr/Kwork: avg: %.2f, min: %.2f, max: %.2f, spread: %.1f%%\n",
+	   avg_ipw, min_ipw, max_ipw,
+	   100.0 * (max_ipw - min_ipw) / MAX(avg_ipw, 0.001));
+    printf("tasks migrated: %.1f%%, spin: %.1f%% of time, %.1f%% of intr\n",
+	   100.0 * tot_mig / (float) MAX(tot_tasks, 1),
+	   100.0 * tot_spin / (1.0e9 * secs[SAMPLE] * args.num_threads),
+	   100.0 * tot_spin_count / (float) MAX(tot_count, 1));
+    barrier_print(&round_barrier, "round");
+    printf("\n");
+
+    EXIT_PASS_FAIL(errs == 0 && tot_count > 0
+		   && 100.0 * (max_ipw - min_ipw) / MAX(avg_ipw, 0.001) < MAX_SPREAD);
+}
@@ -0,0 +1,83 @@
+/*
+ *  Kernel with analytically known event counts.
+ *
+ *  The inner loop is written in asm so that the compiler can't change
+ *  it, and each iteration retires exactly EXACT_INS instructions,
+ *  EXACT_BR conditional branches and EXACT_FP scalar double adds.
+ *  The loop setup and the C code around it add a few dozen
+ *  instructions per unit of work, which is negligible against the
+ *  millions of instructions in one unit.
+ *
+ *  The throttle test uses these counts as an oracle: the expected
+ *  number of events for the work done, compared against interrupts
+ *  times threshold, gives the exact fraction of lost samples.
+ *
+ *  Copyright (c) 2009-2013, Rice University.
+ *  See the file LICENSE for details.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <stdio.h>
+#include "papi-tests.h"
+
+#ifdef __x86_64__
+
+#define EXACT_INS    10
+#define EXACT_BR      1
+#define EXACT_FP      4
+#define EXACT_SCALE  300000
+
+/*
+ *  Per iteration: 4 addsd, 4 add, dec, jnz = 10 instructions, one
+ *  conditional branch and 4 flops.  Each addsd adds 1.0, so after n
+ *  iterations each accumulator is exactly n.
+ */
+static int
+exact_run(struct memory_state *mstate, int work)
+{
+    double one = 1.0, x0, x1, x2, x3;
+    long n, a, b, c, d;
+    int num_errs = 0;
+
+    for (; work > 0; work--) {
+	n = exact_kernel.scale;
+	x0 = x1 = x2 = x3 = 0.0;
+	a = b = c = d = 0;
+	asm volatile (
+	    "1:\n\t"
+	    "addsd  %[one], %[x0]\n\t"
+	    "addsd  %[one], %[x1]\n\t"
+	    "addsd  %[one], %[x2]\n\t"
+	    "addsd  %[one], %[x3]\n\t"
+	    "add    $1, %[a]\n\t"
+	    "add    $1, %[b]\n\t"
+	    "add    $1, %[c]\n\t"
+	    "add    $1, %[d]\n\t"
+	    "dec    %[n]\n\t"
+	    "jnz    1b\n\t"
+	    : [n] "+r" (n), [a] "+r" (a), [b] "+r" (b), [c] "+r" (c),
+	      [d] "+r" (d), [x0] "+x" (x0), [x1] "+x" (x1),
+	      [x2] "+x" (x2), [x3] "+x" (x3)
+	    : [one] "x" (one)
+	    : "cc");
+
+	if (a != exact_kernel.scale || d != exact_kernel.scale
+	    || x0 != (double) exact_kernel.scale
+	    || x3 != (double) exact_kernel.scale) {
+	    warnx("%s: sum is out of range: %ld, %g", __func__, a, x0);
+	    num_errs++;
+	}
+    }
+
+    return (num_errs);
+}
+
+struct work_kernel exact_kernel = {
+    "exact", "asm loop of adds with exact instruction, branch, flop counts",
+    "PAPI_TOT_INS PAPI_BR_INS PAPI_BR_CN PAPI_FP_INS PAPI_FP_OPS",
+    NULL, NULL, NULL, exact_run, EXACT_SCALE,
+    EXACT_INS, EXACT_BR, EXACT_FP, EXACT_FP, 0,
+};
+
+#endif
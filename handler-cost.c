@@ -0,0 +1,347 @@
+/*
+ *  Cost of the common building blocks of an overflow handler.
+ *
+ *  The test runs the -k mix at a fixed, high interrupt rate and the
+ *  handler does one building block per phase:
+ *
+ *    empty   count++ only
+ *    tls     read a __thread variable
+ *    key     pthread_getspecific(), as in threads and thread-over
+ *    index   PAPI_get_overflow_event_index(), as in mult-events
+ *    read    PAPI_read() of the overflow event and its siblings
+ *    time    clock_gettime(CLOCK_MONOTONIC)
+ *    tsc     rdtsc (x86-64 only)
+ *    range   linear scan of a PC over 16 ranges, as in context
+ *
+ *  The phases run round robin in short slices.  Each block is timed
+ *  inside the handler with the cycle counter (rdtsc on x86-64, else
+ *  clock_gettime), less the cost of the empty block, which is the
+ *  cost of the timing itself.  The test also reports the extra time
+ *  per interrupt from the drop in the work rate against the empty
+ *  phase, which includes any effect on the caches.
+ *
+ *  The first event overflows, the rest of the events (default
+ *  PAPI_TOT_INS and PAPI_BR_INS, if available) are counted only, as
+ *  siblings for PAPI_read().
+ *
+ *  Copyright (c) 2009-2013, Rice University.
+ *  See the file LICENSE for details.
+ */
+
+#include <sys/time.h>
+#include <sys/types.h>
+#include <err.h>
+#include <error.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <papi.h>
+#include "papi-tests.h"
+
+#ifdef __x86_64__
+#include <x86intrin.h>
+#endif
+
+#define DEFAULT_TIME       32
+#define DEFAULT_OVERFLOW   100000
+#define MIN_TIME            8
+#define NUM_ROUNDS          4
+#define MIN_SAMPLES       100
+#define NUM_RANGES         16
+#define RANGE_BYTES      4096
+
+#define BLOCK_EMPTY  0
+#define BLOCK_TLS    1
+#define BLOCK_KEY    2
+#define BLOCK_INDEX  3
+#define BLOCK_READ   4
+#define BLOCK_TIME   5
+#define BLOCK_TSC    6
+#define BLOCK_RANGE  7
+#define NUM_BLOCKS   8
+
+static char *block_name[NUM_BLOCKS] = {
+    "empty", "tls", "key", "index", "read", "time", "tsc", "range",
+};
+
+static struct prog_args args;
+static struct memory_state memstate;
+static int EventSet;
+static int num_siblings = 0;
+
+static pthread_key_t key;
+static __thread int my_tid = 0;
+static int tid_value = 0;
+static char *range[NUM_RANGES + 1];
+
+static volatile int block = BLOCK_EMPTY;
+static volatile long count = 0;
+static volatile long ticks = 0;
+static volatile long sink = 0;
+static volatile int handler_errs = 0;
+
+static float tsc_per_ns = 1.0;
+
+static long Samples[NUM_BLOCKS];
+static long Ticks[NUM_BLOCKS];
+static long Work[NUM_BLOCKS];
+static float Secs[NUM_BLOCKS];
+
+/*
+ *  Returns: the cycle counter on x86-64, else nanoseconds.  Both are
+ *  async signal safe.
+ */
+static inline long
+cost_clock(void)
+{
+#ifdef __x86_64__
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return 1000000000L * ts.tv_sec + ts.tv_nsec;
+#endif
+}
+
+void
+my_handler(int EventSet, void *pc, long long ovec, void *context)
+{
+    long long values[MAX_EVENTS];
+    int index[MAX_EVENTS];
+    struct timespec ts;
+    long start;
+    int k, size;
+
+    count++;
+    start = cost_clock();
+
+    switch (block) {
+    case BLOCK_TLS:
+	sink += my_tid;
+	break;
+
+    case BLOCK_KEY:
+	sink += *(int *) pthread_getspecific(key);
+	break;
+
+    case BLOCK_INDEX:
+	size = MAX_EVENTS;
+	if (PAPI_get_overflow_event_index(EventSet, ovec, index, &size)
+	    != PAPI_OK || size < 1)
+	    handler_errs++;
+	else
+	    sink += index[0];
+	break;
+
+    case BLOCK_READ:
+	if (PAPI_read(EventSet, values) != PAPI_OK)
+	    handler_errs++;
+	else
+	    sink += values[num_siblings];
+	break;
+
+    case BLOCK_TIME:
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	sink += ts.tv_nsec;
+	break;
+
+#ifdef __x86_64__
+    case BLOCK_TSC:
+	sink += __rdtsc();
+	break;
+#endif
+
+    case BLOCK_RANGE:
+	for (k = 1; k <= NUM_RANGES; k++) {
+	    if ((char *) pc < range[k])
+		break;
+	}
+	sink += k;
+	break;
+    }
+
+    ticks += cost_clock() - start;
+}
+
+/*
+ *  Run the kernel mix for secs with block b in the handler and add to
+ *  the totals for b.  Returns: the number of errors.
+ */
+int
+run_block(int b, float secs)
+{
+    struct timeval start, now;
+    int work, num_errs;
+
+    block = b;
+    count = 0;
+    ticks = 0;
+    num_errs = 0;
+    work = 0;
+
+    gettimeofday(&start, NULL);
+    if (PAPI_start(EventSet) != PAPI_OK)
+	errx(1, "PAPI_start failed");
+    do {
+	num_errs += run_kernels(&args, &memstate, 5);
+	work += kernel_work(&args, 5);
+	gettimeofday(&now, NULL);
+    }
+    while (time_sub(now, start) < secs);
+    PAPI_stop(EventSet, NULL);
+
+    Samples[b] += count;
+    Ticks[b] += ticks;
+    Work[b] += work;
+    Secs[b] += time_sub(now, start);
+
+    return num_errs;
+}
+
+/*
+ *  Overflow on the first event, count the rest (or the defaults) as
+ *  siblings for PAPI_read().
+ */
+void
+make_event_set(void)
+{
+    static char *sibling_names[] = { "PAPI_TOT_INS", "PAPI_BR_INS" };
+    char name[500];
+    int k, ev;
+
+    EventSet = PAPI_NULL;
+    if (PAPI_create_eventset(&EventSet) != PAPI_OK)
+	errx(1, "PAPI_create_eventset failed");
+
+    for (k = 0; k < args.num_events; k++) {
+	if (PAPI_add_event(EventSet, args.event[k]) != PAPI_OK) {
+	    PAPI_event_code_to_name(args.event[k], name);
+	    errx(1, "PAPI_add_event failed: %s", name);
+	}
+    }
+    num_siblings = args.num_events - 1;
+
+    if (num_siblings == 0) {
+	for (k = 0; k < sizeof(sibling_names) / sizeof(char *); k++) {
+	    if (PAPI_event_name_to_code(sibling_names[k], &ev) == PAPI_OK
+		&& ev != args.event[0]
+		&& PAPI_add_event(EventSet, ev) == PAPI_OK) {
+		args.name[args.num_events] = sibling_names[k];
+		args.event[args.num_events] = ev;
+		args.threshold[args.num_events] = 0;
+		args.num_events++;
+		num_siblings++;
+	    }
+	}
+    }
+
+    if (PAPI_overflow(EventSet, args.event[0], args.threshold[0], 0,
+		      my_handler) != PAPI_OK)
+	errx(1, "PAPI_overflow failed: %s", args.name[0]);
+}
+
+/*
+ *  Rate of cost_clock() in ticks per nanosecond.
+ */
+void
+measure_clock(void)
+{
+    struct timeval start, now;
+    long t0, t1;
+
+    gettimeofday(&start, NULL);
+    t0 = cost_clock();
+    do {
+	gettimeofday(&now, NULL);
+    }
+    while (time_sub(now, start) < 0.2);
+    t1 = cost_clock();
+    tsc_per_ns = (t1 - t0) / (1.0e9 * time_sub(now, start));
+}
+
+int
+main(int argc, char **argv)
+{
+    float slice, base_ticks, net, rate, base_rate, extra;
+    int b, r, k, opt, num_errs;
+
+    set_default_args(&args);
+    args.prog_time = DEFAULT_TIME;
+    args.overflow = DEFAULT_OVERFLOW;
+    opt = parse_args(&args, argc, argv);
+    get_papi_events(&args, opt, argc, argv);
+    if (args.num_events == 0) {
+	TOT_CYC_DEFAULT(args);
+    }
+    set_default_kernels(&args, 0);
+    args.prog_time = MAX(args.prog_time, MIN_TIME);
+    slice = args.prog_time / (float) (NUM_BLOCKS * NUM_ROUNDS);
+
+    if (pthread_key_create(&key, NULL) != 0)
+	errx(1, "pthread_key_create failed");
+    pthread_setspecific(key, &tid_value);
+    for (k = 0; k <= NUM_RANGES; k++)
+	range[k] = (char *) &my_handler + k * RANGE_BYTES;
+
+    make_event_set();
+    measure_clock();
+
+    printf("Handler cost test, time: %d, %s@%d, siblings:", args.prog_time,
+	   args.name[0], args.threshold[0]);
+    for (k = 1; k < args.num_events; k++)
+	printf(" %s", args.name[k]);
+    printf("%s\n", (num_siblings == 0) ? " none" : "");
+    print_kernel_list(&args);
+    printf("cost clock: %.3f ticks/ns\n", tsc_per_ns);
+
+    init_kernels(&args);
+    init_thread_kernels(&args, &memstate);
+
+    num_errs = 0;
+    for (r = 0; r < NUM_ROUNDS; r++) {
+	for (b = 0; b < NUM_BLOCKS; b++) {
+#ifndef __x86_64__
+	    if (b == BLOCK_TSC)
+		continue;
+#endif
+	    num_errs += run_block(b, slice);
+	}
+    }
+
+    /*
+     * Net ticks are less the empty block (the timing itself), extra
+     * ns from the work rate against the empty phase.
+     */
+    base_ticks = Ticks[BLOCK_EMPTY] / (float) MAX(Samples[BLOCK_EMPTY], 1);
+    base_rate = Work[BLOCK_EMPTY] / MAX(Secs[BLOCK_EMPTY], 0.001);
+    printf("\n%-8s  %10s  %10s  %12s  %8s  %10s  %12s\n", "block", "samples",
+	   "intr/sec", "ticks/intr", "ns/intr", "work/sec", "extra ns/intr");
+    for (b = 0; b < NUM_BLOCKS; b++) {
+	if (Samples[b] == 0)
+	    continue;
+	net = Ticks[b] / (float) Samples[b];
+	if (b != BLOCK_EMPTY)
+	    net -= base_ticks;
+	rate = Work[b] / MAX(Secs[b], 0.001);
+	extra = (b == BLOCK_EMPTY) ? 0.0
+	    : 1.0e9 * (Secs[b] - Work[b] / base_rate) / Samples[b];
+	printf("%-8s  %10ld  %10.1f  %12.1f  %8.1f  %10.1f  %12.0f\n",
+	       block_name[b], Samples[b], Samples[b] / MAX(Secs[b], 0.001),
+	       net, net / tsc_per_ns, rate, extra);
+	if (Samples[b] < MIN_SAMPLES) {
+	    warnx("block %s: too few interrupts: %ld", block_name[b], Samples[b]);
+	    num_errs++;
+	}
+    }
+    printf("\nticks and ns for empty are the cost of the timing itself, the\n"
+	   "others are net of empty.  Extra ns is from the drop in work/sec.\n\n");
+
+    if (handler_errs > 0)
+	warnx("errors in the handler: %d", handler_errs);
+
+    EXIT_PASS_FAIL(num_errs == 0 && handler_errs == 0);
+}
@@ -12,6 +12,14 @@
  *  For example, './handler -x 50 PAPI_TOT_CYC:50000' is usually
  *  sufficient to trigger the "I/O possible" bug within seconds.
  *
+ *  The handler doesn't call printf() or gettimeofday(), which are not
+ *  async signal safe and whose locks would add to the handler time.
+ *  Instead, it puts fixed-size records in a preallocated lock-free
+ *  ring (see ring.c) and a helper thread prints them, along with the
+ *  once a second tick and the final result.  So the only work in the
+ *  handler is the -x loop, and the test can't deadlock by interrupting
+ *  the main thread inside stdio.
+ *
  *  Copyright (c) 2009-2013, Rice University.
  *  See the file LICENSE for details.
  *
@@ -25,33 +33,44 @@
 #include <sys/types.h>
 #include <err.h>
 #include <error.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <papi.h>
 #include "papi-tests.h"
 
+#define MESG_RING_SIZE   1024
+#define PRINT_POLL_USEC  10000
+
+struct mesg {
+    struct timespec time;
+    long iter;
+    long count;
+};
+
 static struct prog_args args;
 static int EventSet;
 
-static struct timeval start;
-static struct timeval last;
+static struct ring mesg_ring;
+static pthread_t printer;
 
 static volatile long count = 0;
 static volatile long iter = 1;
 static volatile long last_iter = 0;
-static int num_mesg = 0;
-static int num_errors = 0;
+static volatile int num_mesg = 0;
+static volatile int num_errors = 0;
 
 /*
- * Print messages from inside the handler.  The test passes if we
- * never get any 'no progress' interrupts.
+ * Log messages from inside the handler.  The test passes if we never
+ * get any 'no progress' interrupts.
  */
 void
 my_handler(int EventSet, void *pc, long long ovec, void *context)
 {
-    struct timeval now;
+    struct mesg mesg;
     double x, sum;
     int k;
 
@@ -59,40 +78,23 @@ my_handler(int EventSet, void *pc, long long ovec, void *context)
 
     /*
      * Warn if we get multiple interrupts but no progress in the main
-     * loop, and rate limit the messages.
+     * loop, and rate limit the messages.  clock_gettime() is async
+     * signal safe, gettimeofday() is not.
      */
-    now.tv_sec = 0;
     if (iter == last_iter
 	&& (num_mesg < 5
 	    || (num_mesg < 10 && count % 20 == 0)
 	    || (num_mesg < 15 && count % 100 == 0)
 	    || (num_mesg < 20 && count % 1000 == 0))) {
-	gettimeofday(&now, NULL);
-	printf("time: %ld, main loop: %ld, count: %ld -- no progress\n",
-	       now.tv_sec - start.tv_sec, iter, count);
+	clock_gettime(CLOCK_REALTIME, &mesg.time);
+	mesg.iter = iter;
+	mesg.count = count;
+	ring_put(&mesg_ring, &mesg);
 	num_mesg++;
 	num_errors++;
     }
     last_iter = iter;
 
-    /*
-     * Display tick message one per second and reset the message
-     * count.
-     */
-    if (now.tv_sec == 0 && count % 20 == 0) {
-	gettimeofday(&now, NULL);
-    }
-    if (now.tv_sec > last.tv_sec) {
-	printf("time: %ld, main loop: %ld, count: %ld -- tick\n",
-	       now.tv_sec - start.tv_sec, iter, count);
-	last = now;
-	num_mesg = 0;
-    }
-    if (now.tv_sec > start.tv_sec + args.prog_time) {
-	printf("done, num errors: %d\n", num_errors);
-	EXIT_PASS_FAIL(num_errors == 0);
-    }
-
     /*
      * Churn cycles before returning.
      */
@@ -107,6 +109,44 @@ my_handler(int EventSet, void *pc, long long ovec, void *context)
     }
 }
 
+/*
+ * Print the handler's messages and a tick once per second, reset the
+ * message count, and exit at the end of the run.  This thread doesn't
+ * use PAPI, so it never runs the handler.
+ */
+void *
+print_thread(void *data)
+{
+    struct timeval start, last, now;
+    struct mesg mesg;
+
+    gettimeofday(&start, NULL);
+    last = start;
+
+    for (;;) {
+	while (ring_get(&mesg_ring, &mesg)) {
+	    printf("time: %ld, main loop: %ld, count: %ld -- no progress\n",
+		   mesg.time.tv_sec - start.tv_sec, mesg.iter, mesg.count);
+	}
+	gettimeofday(&now, NULL);
+	if (now.tv_sec > last.tv_sec) {
+	    printf("time: %ld, main loop: %ld, count: %ld -- tick\n",
+		   now.tv_sec - start.tv_sec, iter, count);
+	    last = now;
+	    num_mesg = 0;
+	}
+	if (now.tv_sec > start.tv_sec + args.prog_time) {
+	    if (mesg_ring.drops > 0)
+		printf("messages dropped: %ld\n", mesg_ring.drops);
+	    printf("done, num errors: %d\n", num_errors);
+	    EXIT_PASS_FAIL(num_errors == 0);
+	}
+	fflush(stdout);
+	usleep(PRINT_POLL_USEC);
+    }
+    return NULL;
+}
+
 /*
  * Churn cycles forever in the main program and count loop iterations
  * to see if it makes progress.
@@ -117,8 +157,9 @@ run_test(void)
     double x, sum;
     long k;
 
-    gettimeofday(&start, NULL);
-    last = start;
+    ring_init(&mesg_ring, MESG_RING_SIZE, sizeof(struct mesg));
+    if (pthread_create(&printer, NULL, print_thread, NULL) != 0)
+	errx(1, "pthread create failed");
 
     if (PAPI_start(EventSet) != PAPI_OK)
         errx(1, "PAPI_start failed");
@@ -0,0 +1,133 @@
+/*
+ *  Kernel for instruction cache and iTLB misses.
+ *
+ *  Build a large code footprint at runtime by writing many small
+ *  functions into executable mmap pages and call through them in
+ *  pseudo-random order.  The footprint is much larger than the L2
+ *  cache and spans more pages than the iTLB covers, so most calls
+ *  take an icache miss and many take an iTLB miss.
+ *
+ *  This writes raw machine code, so it is x86-64 only.
+ *
+ *  Copyright (c) 2009-2013, Rice University.
+ *  See the file LICENSE for details.
+ */
+
+#include <sys/mman.h>
+#include <err.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "papi-tests.h"
+
+#ifdef __x86_64__
+
+/*
+ *  Each block is a function int f(int x) that returns x + BLOCK_ADDS,
+ *  two blocks per page.  Blocks are staggered by a cache line from
+ *  page to page so that they don't all land in the same cache sets.
+ */
+#define CODE_MEGS        16
+#define BLOCKS_PER_PAGE  2
+#define BLOCK_ADDS       64
+#define ICACHE_SCALE     8000
+
+typedef int code_block_t(int);
+
+static char *code_addr = NULL;
+static long code_bytes;
+static long num_blocks;
+static long block_size;
+
+static code_block_t *
+code_block(long b)
+{
+    long page = b / BLOCKS_PER_PAGE;
+    long off = (page % (block_size / 64 / 2)) * 64;
+
+    return (code_block_t *) (code_addr + b * block_size + off);
+}
+
+static void
+icache_init(struct prog_args *args)
+{
+    long page_size, b, k;
+    unsigned char *p;
+    int flags;
+
+    page_size = sysconf(_SC_PAGESIZE);
+    code_bytes = CODE_MEGS * 1024L * 1024L;
+    block_size = page_size / BLOCKS_PER_PAGE;
+    num_blocks = (code_bytes / page_size) * BLOCKS_PER_PAGE;
+
+#ifdef MAP_ANONYMOUS
+    flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#else
+    flags = MAP_PRIVATE | MAP_ANON;
+#endif
+    code_addr = mmap(NULL, code_bytes, PROT_READ | PROT_WRITE,
+		     flags, -1, 0);
+    if (code_addr == MAP_FAILED) {
+	errx(1, "%s: mmap(%d meg) failed", __func__, CODE_MEGS);
+    }
+
+    /* Fill with int3 so a stray jump traps instead of sliding. */
+    memset(code_addr, 0xcc, code_bytes);
+
+    for (b = 0; b < num_blocks; b++) {
+	p = (unsigned char *) code_block(b);
+
+	/* mov %edi, %eax */
+	*p++ = 0x89;  *p++ = 0xf8;
+	/* add $1, %eax */
+	for (k = 0; k < BLOCK_ADDS; k++) {
+	    *p++ = 0x83;  *p++ = 0xc0;  *p++ = 0x01;
+	}
+	/* ret */
+	*p++ = 0xc3;
+    }
+
+    if (mprotect(code_addr, code_bytes, PROT_READ | PROT_EXEC) != 0) {
+	err(1, "%s: mprotect(PROT_EXEC) failed", __func__);
+    }
+}
+
+/*
+ *  Call scale blocks per unit of work in the order given by
+ *  random_gen() and check that each call added BLOCK_ADDS.
+ */
+static int
+icache_run(struct memory_state *mstate, int work)
+{
+    long k, calls;
+    int x, num_errs;
+
+    if (mstate->code_seed <= 0)
+	mstate->code_seed = 1;
+
+    num_errs = 0;
+    for (; work > 0; work--) {
+	x = 0;
+	calls = 0;
+	for (k = 0; k < icache_kernel.scale; k++) {
+	    mstate->code_seed = random_gen(mstate->code_seed);
+	    x = code_block(mstate->code_seed % num_blocks)(x);
+	    calls++;
+	}
+	if (x != calls * BLOCK_ADDS) {
+	    warnx("%s: sum is out of range: %d", __func__, x);
+	    num_errs++;
+	}
+    }
+
+    return (num_errs);
+}
+
+struct work_kernel icache_kernel = {
+    "icache", "random calls through 16 meg of generated code",
+    "PAPI_L1_ICM PAPI_L2_ICM PAPI_TLB_IM",
+    icache_init, NULL, NULL, icache_run, ICACHE_SCALE, 0, 0, 0, 0, 0,
+};
+
+#endif
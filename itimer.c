@@ -183,6 +183,7 @@ run_test(int tid)
 	while (work < args.work);
 
 	gettimeofday(&now, NULL);
+	topology_check_cpu(tid);
 	if (tid == 0 || !args.single) {
 	    printf("time: %.1f, tid: %d, work: %d, count: %ld%s",
 		   time_sub(now, start), tid, work, count[tid], eol);
@@ -224,6 +225,7 @@ my_thread(void *data)
     if (pthread_setspecific(key, data) != 0) {
 	errx(1, "pthread_setspecific failed");
     }
+    topology_pin(tid);
 
 #if defined(RTIMER) || defined(CTIMER)
     memset(&sev[tid], 0, sizeof(struct sigevent));
@@ -292,6 +294,7 @@ main(int argc, char **argv)
     memset(&itval_stop, 0, sizeof(itval_stop));
     memset(&itspec_stop, 0, sizeof(itspec_stop));
 
+    topology_init(&args);
     for (k = 0; k < MAX_THREADS; k++) {
 	tid[k] = k;
     }
@@ -326,8 +329,9 @@ main(int argc, char **argv)
 
     pass = 1;
     for (k = 0; k < args.num_threads; k++) {
-	printf("tid: %d, min: %ld, avg: %.1f, max: %ld\n",
-	       k, rep[k].min, rep[k].avg, rep[k].max);
+	printf("tid: %d, min: %ld, avg: %.1f, max: %ld, cpu: %d, moves: %ld\n",
+	       k, rep[k].min, rep[k].avg, rep[k].max,
+	       topology_last_cpu(k), topology_moves(k));
 	pass = pass && rep[k].pass;
     }
 
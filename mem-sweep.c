@@ -0,0 +1,134 @@
+/*
+ *  Sweep the working set of the walk kernel through the cache
+ *  hierarchy (L1, L2, LLC, DRAM) and report the interrupt rate and
+ *  the work rate at each size.
+ *
+ *  The working set starts at -W kB (default 4) and doubles up to the
+ *  -m size, with the access pattern from -a.  The kernel is calibrated
+ *  once at the smallest size and that scale is kept for all sizes, so
+ *  work/sec falls off as the set falls out of each cache level.  With
+ *  a cache miss event, intr/Kwork shows where overflow on that event
+ *  becomes reliable, and comparing -a chase (latency bound) with -a
+ *  seq (bandwidth bound) shows how the sampling overhead differs.
+ *
+ *  Copyright (c) 2009-2013, Rice University.
+ *  See the file LICENSE for details.
+ */
+
+#include <sys/time.h>
+#include <sys/types.h>
+#include <err.h>
+#include <error.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <papi.h>
+#include "papi-tests.h"
+
+#define MIN_KB      4
+#define MAX_SIZES  40
+#define MIN_STEP_TIME  1.0
+
+static struct prog_args args;
+static struct memory_state memstate;
+static int EventSet;
+
+static long Size[MAX_SIZES];
+static int num_sizes;
+static volatile long count = 0;
+
+void
+my_handler(int EventSet, void *pc, long long ovec, void *context)
+{
+    count++;
+}
+
+/*
+ *  Run the walk kernel over kb for step_time seconds.  Returns the
+ *  number of errors.
+ */
+int
+run_size(long kb, float step_time)
+{
+    struct timeval start, now;
+    float delta_t, fcount, fwork, ns;
+    int work, num_errs;
+
+    args.walk_kb = kb;
+    walk_kernel.thread_fini(&memstate);
+    walk_kernel.thread_init(&args, &memstate);
+    num_errs = run_kernels(&args, &memstate, 1);
+
+    count = 0;
+    work = 0;
+    gettimeofday(&start, NULL);
+    if (PAPI_start(EventSet) != PAPI_OK)
+	errx(1, "PAPI_start failed");
+    do {
+	num_errs += run_kernels(&args, &memstate, 5);
+	work += kernel_work(&args, 5);
+	gettimeofday(&now, NULL);
+	delta_t = time_sub(now, start);
+    }
+    while (delta_t < step_time);
+    PAPI_stop(EventSet, NULL);
+
+    fcount = (float) count;
+    fwork = (float) work;
+    ns = 1.0e9 * delta_t / (fwork * walk_kernel.scale);
+    printf("%10ld  %8d  %6.1f  %10ld  %10.1f  %10.2f  %10.1f  %8.2f\n",
+	   kb, work, delta_t, count, fcount/delta_t, 1000.0*fcount/fwork,
+	   fwork/delta_t, ns);
+    fflush(stdout);
+
+    return (num_errs);
+}
+
+int
+main(int argc, char **argv)
+{
+    float step_time;
+    long kb, max_kb;
+    int opt, k, num_errs;
+
+    set_default_args(&args);
+    opt = parse_args(&args, argc, argv);
+    get_papi_events(&args, opt, argc, argv);
+    if (args.num_events == 0) {
+	TOT_CYC_DEFAULT(args);
+    }
+    args.num_kernels = 0;
+    add_kernels(&args, "walk");
+
+    kb = (args.walk_kb > 0) ? args.walk_kb : MIN_KB;
+    max_kb = MAX(1024L * args.memsize, kb);
+    for (num_sizes = 0; num_sizes < MAX_SIZES && kb <= max_kb; num_sizes++) {
+	Size[num_sizes] = kb;
+	kb *= 2;
+    }
+    step_time = MAX(args.prog_time / (float) num_sizes, MIN_STEP_TIME);
+
+    printf("Memory Sweep test, time: %d, pattern: %s, sizes: %ld to %ld kB\n",
+	   args.prog_time, walk_pattern_name(args.walk_pattern),
+	   Size[0], Size[num_sizes - 1]);
+    print_event_list(&args);
+    print_kernel_list(&args);
+
+    EventSet = event_set_for_overflow(&args, &my_handler);
+    args.walk_kb = Size[0];
+    init_kernels(&args);
+    init_thread_kernels(&args, &memstate);
+
+    printf("\n%10s  %8s  %6s  %10s  %10s  %10s  %10s  %8s\n",
+	   "size (kB)", "work", "time", "count", "intr/sec", "intr/Kwork",
+	   "work/sec", "ns/acc");
+
+    num_errs = 0;
+    for (k = 0; k < num_sizes; k++) {
+	num_errs += run_size(Size[k], step_time);
+    }
+    walk_kernel.thread_fini(&memstate);
+
+    EXIT_PASS_FAIL(num_errs == 0);
+}
@@ -53,6 +53,8 @@ my_handler(int EventSet, void *pc, long long ovec, void *context)
 	count[array[k]]++;
     }
     total++;
+    if (args.ring_size > 0)
+	sampler_record(0, pc, ovec);
 }
 
 /*
@@ -65,6 +67,7 @@ run_test(void)
 {
     struct timeval start, now;
     struct timeval nonzero[MAX_EVENTS];
+    char wstr[50];
     int k, work, num_errs;
 
     for (k = 0; k < args.num_events; k++) {
@@ -75,6 +78,10 @@ run_test(void)
     for (k = 0; k < args.num_events; k++) {
 	nonzero[k] = start;
     }
+    if (args.ring_size > 0) {
+	sampler_start(&args, 1);
+	sampler_thread_init(0);
+    }
     if (PAPI_start(EventSet) != PAPI_OK)
 	errx(1, "PAPI_start failed");
 
@@ -87,18 +94,14 @@ run_test(void)
 	total = 0;
 	work = 0;
 	do {
-	    num_errs += run_flops(5);
-	    work += 5;
-	    if (args.memsize > 0) {
-		num_errs += run_memory(&memstate, 5);
-		work += 5;
-	    }
+	    num_errs += run_kernels(&args, &memstate, 5);
+	    work += kernel_work(&args, 5);
 	}
 	while (work < args.work);
 
 	gettimeofday(&now, NULL);
-	printf("time: %.1f, work: %d, counts: %ld",
-	       time_sub(now, start), args.work, count[0]);
+	printf("time: %.1f, work: %s, counts: %ld", time_sub(now, start),
+	       work_str(&args, work, wstr, sizeof(wstr)), count[0]);
 	for (k = 1; k < args.num_events; k++) {
 	    printf(", %ld", count[k]);
 	}
@@ -123,6 +126,8 @@ run_test(void)
     while (time_sub(now, start) <= args.prog_time);
 
     PAPI_stop(EventSet, NULL);
+    if (args.ring_size > 0)
+	num_errs += sampler_stop();
 
     for (k = 0; k < args.num_events; k++) {
 	rep[k].avg = rep[k].total / (float)rep[k].num;
@@ -149,12 +154,16 @@ main(int argc, char **argv)
 	args.threshold[2] = 200000;
 	args.num_events = 3;
     }
+    set_default_kernels(&args, 1);
     args.prog_time = MAX(args.prog_time, 15);
 
     printf("Multiple Events Stress test, time: %d\n", args.prog_time);
     print_event_list(&args);
+    print_kernel_list(&args);
 
-    init_memory(&memstate, args.memsize);
+    init_kernels(&args);
+    init_thread_kernels(&args, &memstate);
+    print_memory_info(&memstate, -1);
     EventSet = event_set_for_overflow(&args, &my_handler);
 
     run_test();
@@ -37,6 +37,8 @@ void
 my_handler(int EventSet, void *pc, long long ovec, void *context)
 {
     count++;
+    if (args.ring_size > 0)
+	sampler_record(0, pc, ovec);
 }
 
 /*
@@ -49,6 +51,7 @@ run_test(void)
 {
     struct timeval start, nonzero, now, last;
     char *eol = (args.verbose) ? ", " : "\n";
+    char wstr[50];
     int work, num_errs;
 
     INIT_REPORT(rep);
@@ -57,6 +60,10 @@ run_test(void)
     nonzero = start;
     last = start;
 
+    if (args.ring_size > 0) {
+	sampler_start(&args, 1);
+	sampler_thread_init(0);
+    }
     if (PAPI_start(EventSet) != PAPI_OK)
 	errx(1, "PAPI_start failed");
 
@@ -66,18 +73,14 @@ run_test(void)
 	count = 0;
 	work = 0;
 	do {
-	    num_errs += run_flops(5);
-	    work += 5;
-	    if (args.memsize > 0) {
-		num_errs += run_memory(&memstate, 5);
-		work += 5;
-	    }
+	    num_errs += run_kernels(&args, &memstate, 5);
+	    work += kernel_work(&args, 5);
 	}
 	while (work < args.work);
 
 	gettimeofday(&now, NULL);
-	printf("time: %.1f, work: %d, count: %ld%s",
-	       time_sub(now, start), work, count, eol);
+	printf("time: %.1f, work: %s, count: %ld%s", time_sub(now, start),
+	       work_str(&args, work, wstr, sizeof(wstr)), count, eol);
 	if (args.verbose) {
 	    float fcount = (float) count;
 	    float fwork = (float) work;
@@ -102,6 +105,8 @@ run_test(void)
     while (time_sub(now, start) <= args.prog_time);
 
     PAPI_stop(EventSet, NULL);
+    if (args.ring_size > 0)
+	num_errs += sampler_stop();
 
     rep.avg = rep.total / (float)rep.num;
     rep.pass = (num_errs == 0) && (rep.min > 0.75 * rep.avg)
@@ -119,13 +124,17 @@ main(int argc, char **argv)
     if (args.num_events == 0) {
 	TOT_CYC_DEFAULT(args);
     }
+    set_default_kernels(&args, 1);
     args.prog_time = MAX(args.prog_time, 15);
 
     printf("Nonthread Stress test, time: %d\n", args.prog_time);
     print_event_list(&args);
+    print_kernel_list(&args);
 
     EventSet = event_set_for_overflow(&args, &my_handler);
-    init_memory(&memstate, args.memsize);
+    init_kernels(&args);
+    init_thread_kernels(&args, &memstate);
+    print_memory_info(&memstate, -1);
 
     run_test();
 
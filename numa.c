@@ -0,0 +1,259 @@
+/*
+ *  NUMA placement for the per-thread memory arrays.
+ *
+ *  By default, pages go wherever the kernel decides, which on multi-
+ *  socket machines makes the work rates between threads very uneven.
+ *  With -N, we bind the array to a policy before the first touch:
+ *
+ *    local       bind to the node of the CPU doing init_memory()
+ *    interleave  interleave over all nodes
+ *    remote      bind to the next node after the local one that has
+ *                memory and is in the process's allowed set
+ *
+ *  We use the mbind() and move_pages() syscalls directly so as not to
+ *  require libnuma.  Afterwards, we sample the pages with move_pages()
+ *  to report the fraction that are on the node the thread was on when
+ *  the array was bound.
+ *
+ *  Copyright (c) 2009-2013, Rice University.
+ *  See the file LICENSE for details.
+ */
+
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <err.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "papi-tests.h"
+
+/* From <numaif.h>, the kernel ABI. */
+#ifndef MPOL_BIND
+#define MPOL_BIND        2
+#define MPOL_INTERLEAVE  3
+#endif
+
+#define MAX_NODES     1024
+#define LOCALITY_PAGES  1024
+#define LONG_BITS  (8 * sizeof(unsigned long))
+
+static char *policy_name[] = { "none", "local", "interleave", "remote" };
+
+/*
+ *  Returns: the number of nodes from /sys/devices/system/node/online
+ *  (eg, "0-3"), or 1 if not found.
+ */
+int
+numa_num_nodes(void)
+{
+    char line[500], *p;
+    int lo, hi, num;
+    FILE *fp;
+
+    num = 1;
+    fp = fopen("/sys/devices/system/node/online", "r");
+    if (fp == NULL)
+	return 1;
+    if (fgets(line, sizeof(line), fp) != NULL) {
+	for (p = strtok(line, ",\n"); p != NULL; p = strtok(NULL, ",\n")) {
+	    if (sscanf(p, "%d-%d", &lo, &hi) == 2)
+		num = MAX(num, hi + 1);
+	    else if (sscanf(p, "%d", &lo) == 1)
+		num = MAX(num, lo + 1);
+	}
+    }
+    fclose(fp);
+
+    return MIN(num, MAX_NODES);
+}
+
+/*
+ *  Returns: the node of the CPU we're running on, or 0 if unknown.
+ */
+int
+numa_current_node(void)
+{
+#ifdef SYS_getcpu
+    unsigned int cpu, node;
+
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0)
+	return node;
+#endif
+    return 0;
+}
+
+/*
+ *  Parse a node list (eg, "0-3,6") from the line into mask.  Returns:
+ *  1 if any node was found, else 0.
+ */
+static int
+parse_node_list(char *line, unsigned long *mask)
+{
+    char *p, *save;
+    int lo, hi, k, found;
+
+    found = 0;
+    for (p = strtok_r(line, ",\n", &save); p != NULL;
+	 p = strtok_r(NULL, ",\n", &save))
+    {
+	if (sscanf(p, "%d-%d", &lo, &hi) < 2) {
+	    if (sscanf(p, "%d", &lo) < 1)
+		continue;
+	    hi = lo;
+	}
+	for (k = MAX(lo, 0); k <= hi && k < MAX_NODES; k++) {
+	    mask[k / LONG_BITS] |= 1UL << (k % LONG_BITS);
+	    found = 1;
+	}
+    }
+    return found;
+}
+
+/*
+ *  Fill in mask with the nodes that have memory and that the process
+ *  may allocate from (Mems_allowed_list in /proc/self/status).  If
+ *  either is unknown, skip that test.
+ */
+static void
+numa_usable_nodes(unsigned long *mask, int num_nodes)
+{
+    unsigned long mem[MAX_NODES / LONG_BITS], allowed[MAX_NODES / LONG_BITS];
+    char line[4096];
+    int have_mem, have_allowed, k;
+    FILE *fp;
+
+    memset(mem, 0, sizeof(mem));
+    memset(allowed, 0, sizeof(allowed));
+    have_mem = 0;
+    have_allowed = 0;
+
+    fp = fopen("/sys/devices/system/node/has_memory", "r");
+    if (fp != NULL) {
+	if (fgets(line, sizeof(line), fp) != NULL)
+	    have_mem = parse_node_list(line, mem);
+	fclose(fp);
+    }
+    fp = fopen("/proc/self/status", "r");
+    if (fp != NULL) {
+	while (fgets(line, sizeof(line), fp) != NULL) {
+	    if (strncmp(line, "Mems_allowed_list:", 18) == 0) {
+		have_allowed = parse_node_list(line + 18, allowed);
+		break;
+	    }
+	}
+	fclose(fp);
+    }
+
+    memset(mask, 0, MAX_NODES / 8);
+    for (k = 0; k < num_nodes; k++) {
+	if ((! have_mem || (mem[k / LONG_BITS] & (1UL << (k % LONG_BITS))))
+	    && (! have_allowed
+		|| (allowed[k / LONG_BITS] & (1UL << (k % LONG_BITS)))))
+	    mask[k / LONG_BITS] |= 1UL << (k % LONG_BITS);
+    }
+}
+
+char *
+numa_policy_name(int policy)
+{
+    return (policy >= 0 && policy <= NUMA_REMOTE) ? policy_name[policy] : "?";
+}
+
+/*
+ *  Bind [addr, addr + bytes) to the policy.  Must be called after
+ *  mmap() and before the pages are touched.
+ */
+void
+numa_bind_memory(struct memory_state *mstate, int policy)
+{
+    unsigned long mask[MAX_NODES / LONG_BITS];
+    unsigned long usable[MAX_NODES / LONG_BITS];
+    int mode, node, num_nodes, k, next;
+
+    mstate->numa_node = numa_current_node();
+    if (policy == NUMA_NONE || mstate->addr == NULL)
+	return;
+
+#ifdef SYS_mbind
+    num_nodes = numa_num_nodes();
+    memset(mask, 0, sizeof(mask));
+    mode = MPOL_BIND;
+    node = mstate->numa_node;
+
+    if (policy == NUMA_INTERLEAVE) {
+	mode = MPOL_INTERLEAVE;
+	for (k = 0; k < num_nodes; k++)
+	    mask[k / LONG_BITS] |= 1UL << (k % LONG_BITS);
+    }
+    else {
+	if (policy == NUMA_REMOTE) {
+	    /* The next usable node after ours, skip memoryless nodes. */
+	    numa_usable_nodes(usable, num_nodes);
+	    for (k = 1; k < num_nodes; k++) {
+		next = (node + k) % num_nodes;
+		if (usable[next / LONG_BITS] & (1UL << (next % LONG_BITS)))
+		    break;
+	    }
+	    if (k < num_nodes)
+		node = next;
+	    else
+		warnx("%s: no other node with memory, remote is the same "
+		      "as local", __func__);
+	}
+	mask[node / LONG_BITS] |= 1UL << (node % LONG_BITS);
+    }
+
+    if (syscall(SYS_mbind, mstate->addr, mstate->bytes, mode, mask,
+		(unsigned long) MAX_NODES, 0) != 0) {
+	warn("%s: mbind(%s) failed", __func__, numa_policy_name(policy));
+    }
+#else
+    warnx("%s: mbind is not supported on this system", __func__);
+#endif
+}
+
+/*
+ *  Sample the array's pages and set local_pct to the percent that
+ *  are on mstate->numa_node, the node at bind time, or -1 if unknown.
+ */
+void
+numa_locality(struct memory_state *mstate)
+{
+    void *pages[LOCALITY_PAGES];
+    int status[LOCALITY_PAGES];
+    long page_size, num_pages, step, k, n;
+    int node, num_local, num_found;
+
+    mstate->local_pct = -1.0;
+    if (mstate->addr == NULL)
+	return;
+
+#ifdef SYS_move_pages
+    page_size = sysconf(_SC_PAGESIZE);
+    num_pages = mstate->bytes / page_size;
+    step = MAX(num_pages / LOCALITY_PAGES, 1);
+    n = 0;
+    for (k = 0; k < num_pages && n < LOCALITY_PAGES; k += step) {
+	pages[n++] = (char *) mstate->addr + k * page_size;
+    }
+
+    if (syscall(SYS_move_pages, 0, n, pages, NULL, status, 0) != 0)
+	return;
+
+    node = mstate->numa_node;
+    num_local = 0;
+    num_found = 0;
+    for (k = 0; k < n; k++) {
+	if (status[k] >= 0) {
+	    num_found++;
+	    if (status[k] == node)
+		num_local++;
+	}
+    }
+    if (num_found > 0)
+	mstate->local_pct = 100.0 * num_local / (float) num_found;
+#endif
+}
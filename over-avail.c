@@ -154,10 +154,7 @@ run_test(int ev)
     total = 0;
     memstate.seed = 1;
     do {
-	run_flops(10);
-	if (args.memsize > 0) {
-	    run_memory(&memstate, 10);
-	}
+	run_kernels(&args, &memstate, 10);
 
 	gettimeofday(&now, NULL);
 	if (time_sub(now, last) >= 1.0) {
@@ -198,10 +195,25 @@ main(int argc, char **argv)
     opt = parse_args(&args, argc, argv);
     get_papi_events(&args, opt, argc, argv);
 
+    /*
+     * Add icache and vector (if available) to trigger front-end and
+     * packed flop events.
+     */
+    if (args.num_kernels == 0) {
+	set_default_kernels(&args, 1);
+	if (find_kernel("icache") != NULL)
+	    add_kernels(&args, "icache");
+	if (find_kernel("vector") != NULL)
+	    add_kernels(&args, "vector");
+    }
+
     printf("Overflow Available test, threshold: %d, time: %d\n",
 	   args.overflow, args.prog_time);
+    print_kernel_list(&args);
 
-    init_memory(&memstate, args.memsize);
+    init_kernels(&args);
+    init_thread_kernels(&args, &memstate);
+    print_memory_info(&memstate, -1);
     ev = PAPI_PRESET_MASK;
 #ifdef PAPI_ENUM_FIRST
     PAPI_enum_event(&ev, PAPI_ENUM_FIRST);
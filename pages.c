@@ -0,0 +1,114 @@
+/*
+ *  Report which page size the memory array actually got.
+ *
+ *  Asking for huge pages is only a hint for THP (and the kernel may
+ *  not have huge pages to give for MAP_HUGETLB), so we read back the
+ *  page size and the amount of THP memory for the array's range from
+ *  /proc/self/smaps.
+ *
+ *  Copyright (c) 2009-2013, Rice University.
+ *  See the file LICENSE for details.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "papi-tests.h"
+
+#define LINE_SIZE  1024
+
+/*
+ *  Returns: the default huge page size in kB from /proc/meminfo, or
+ *  2048 if not found.
+ */
+long
+huge_page_kb(void)
+{
+    char line[LINE_SIZE];
+    long kb = 0;
+    FILE *fp;
+
+    fp = fopen("/proc/meminfo", "r");
+    if (fp != NULL) {
+	while (fgets(line, LINE_SIZE, fp) != NULL) {
+	    if (sscanf(line, "Hugepagesize: %ld", &kb) == 1)
+		break;
+	}
+	fclose(fp);
+    }
+    return (kb > 0) ? kb : 2048;
+}
+
+/*
+ *  Fill in page_kb and huge_kb for the array from the smaps entries
+ *  that overlap it.  Madvise() may split the mapping into several
+ *  entries, so sum over all of them.
+ */
+void
+get_page_info(struct memory_state *mstate)
+{
+    unsigned long start, end, lo, hi;
+    char line[LINE_SIZE];
+    long val;
+    int in_range;
+    FILE *fp;
+
+    mstate->page_kb = sysconf(_SC_PAGESIZE) / 1024;
+    mstate->huge_kb = 0;
+    if (mstate->addr == NULL)
+	return;
+
+    fp = fopen("/proc/self/smaps", "r");
+    if (fp == NULL)
+	return;
+
+    lo = (unsigned long) mstate->addr;
+    hi = lo + mstate->bytes;
+    in_range = 0;
+    while (fgets(line, LINE_SIZE, fp) != NULL) {
+	if (sscanf(line, "%lx-%lx", &start, &end) == 2) {
+	    in_range = (start < hi && end > lo);
+	}
+	else if (in_range
+		 && sscanf(line, "KernelPageSize: %ld", &val) == 1) {
+	    mstate->page_kb = MAX(mstate->page_kb, val);
+	}
+	else if (in_range
+		 && sscanf(line, "AnonHugePages: %ld", &val) == 1) {
+	    mstate->huge_kb += val;
+	}
+    }
+    fclose(fp);
+}
+
+/*
+ *  Print the page size, NUMA locality and init time for the array,
+ *  tid < 0 for non-threaded.
+ */
+void
+print_memory_info(struct memory_state *mstate, int tid)
+{
+    char buf[50], numa[100];
+    long kb;
+
+    if (mstate->addr == NULL)
+	return;
+
+    buf[0] = 0;
+    if (tid >= 0)
+	snprintf(buf, sizeof(buf), "tid: %d, ", tid);
+    numa[0] = 0;
+    if (mstate->local_pct >= 0.0)
+	snprintf(numa, sizeof(numa), ", node: %d, local: %.0f%%",
+		 mstate->numa_node, mstate->local_pct);
+    kb = mstate->bytes / 1024;
+    printf("%smemory: %ld meg, page size: %ld kB, THP: %ld kB (%.0f%%)%s, "
+	   "init: %.3fs\n",
+	   buf, (long) (mstate->bytes / (1024 * 1024)), mstate->page_kb,
+	   mstate->huge_kb, 100.0 * mstate->huge_kb / (float) MAX(kb, 1),
+	   numa, mstate->init_secs);
+}
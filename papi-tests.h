@@ -21,6 +21,11 @@
 
 #define MAX_EVENTS   20
 #define MAX_THREADS  550
+#define MAX_KERNELS  20
+#define MAX_INIT_THREADS  256
+#define MAX_DEPTHS   16
+#define MAX_SWEEP    16
+#define MAX_UNWIND_DEPTH  4096
 
 #define DEFAULT_PROG_TIME	60
 #define DEFAULT_NUM_THREADS	4
@@ -29,6 +34,71 @@
 #define DEFAULT_MEMSIZE		40
 #define DEFAULT_HANDLER_ITER	50
 #define DEFAULT_STAGGER_DELAY   0
+#define DEFAULT_UNIT_USEC	1000
+#define DEFAULT_BRANCH_PCT	50
+#define DEFAULT_STACK_DEPTH	32
+
+#define MAX_MEMSIZE		2000
+#define MAX_LARGE_MEMSIZE	(1024 * 1024)
+
+/* Page modes for the memory array (-H). */
+#define PAGE_HUGETLB   1
+#define PAGE_THP       2
+#define PAGE_NOTHP     4
+#define PAGE_POPULATE  8
+#define PAGE_LOCK     16
+
+/* NUMA policies for the memory array (-N). */
+#define NUMA_NONE        0
+#define NUMA_LOCAL       1
+#define NUMA_INTERLEAVE  2
+#define NUMA_REMOTE      3
+
+/* Access patterns for the walk kernel (-a). */
+#define WALK_SEQ     0
+#define WALK_STRIDE  1
+#define WALK_RANDOM  2
+#define WALK_CHASE   3
+
+#define PIN_NONE     0
+#define PIN_COMPACT  1
+#define PIN_SCATTER  2
+#define PIN_CORE     3
+#define PIN_SMT      4
+
+#define UNWIND_NONE   0
+#define UNWIND_FP     1
+#define UNWIND_TABLE  2
+
+struct prog_args;
+struct memory_state;
+
+/*
+ *  A workload kernel.  init() is called once per process and
+ *  thread_init() once per memory state (thread), any of init,
+ *  thread_init and thread_fini may be NULL.  run() does 'work' units
+ *  of work and returns the number of errors.  One unit is 'scale'
+ *  iterations of the kernel's inner loop, see calib.c.  Events is a
+ *  hint of which events the kernel is meant to trigger.  Ins, br,
+ *  fp_ins and fp_ops are the exact number of instructions,
+ *  conditional branches, FP instructions and flops per iteration, or
+ *  0 if not known.
+ */
+struct work_kernel {
+    char *name;
+    char *desc;
+    char *events;
+    void (*init)(struct prog_args *);
+    void (*thread_init)(struct prog_args *, struct memory_state *);
+    void (*thread_fini)(struct memory_state *);
+    int  (*run)(struct memory_state *, int);
+    long scale;
+    long ins;
+    long br;
+    long fp_ins;
+    long fp_ops;
+    long bytes;
+};
 
 struct prog_args {
     int prog_time;
@@ -36,23 +106,87 @@ struct prog_args {
     int overflow;
     int work;
     int memsize;
+    int large_mem;
+    int page_mode;
+    int numa_policy;
+    int init_threads;
+    int init_stream;
+    int walk_pattern;
+    int walk_stride;
+    long walk_kb;
+    int branch_pct;
+    int share_degree;
+    long ring_size;
+    int pin_policy;
+    int unwind_mode;
+    int unwind_max;
+    int stack_depth;
+    int num_depths;
+    int depth[MAX_DEPTHS];
+    int num_sweep;
+    int sweep[MAX_SWEEP];
     int handler_iter;
     int manual_restart;
     int single;
     int stagger_delay;
     int sleep;
+    int unit_usec;
+    int recalibrate;
+    int each_kernel;
     int verbose;
     int num_events;
     char *name[MAX_EVENTS];
     int event[MAX_EVENTS];
     int threshold[MAX_EVENTS];
+    int num_kernels;
+    struct work_kernel *kernel[MAX_KERNELS];
+    int weight[MAX_KERNELS];
 };
 
 struct memory_state {
+    int tid;
     int *addr;
     size_t bytes;
     long size;
     long seed;
+    unsigned long seed64;
+    long code_seed;
+    void *map_addr;
+    size_t map_bytes;
+    long page_kb;
+    long huge_kb;
+    int numa_node;
+    float local_pct;
+    float init_secs;
+    int large;
+    void *walk_lines;
+    long walk_size;
+    long walk_pos;
+    double *stream_a;
+    double *stream_b;
+    double *stream_c;
+    long stream_size;
+    long stream_pos;
+};
+
+struct ring {
+    char *buf;
+    long elem_size;
+    long mask;
+    volatile long head;
+    volatile long tail;
+    volatile long drops;
+};
+
+struct barrier {
+    int num;
+    volatile int count;
+    volatile int gen;
+    volatile long release;
+    volatile long crossings;
+    volatile long wakes;
+    volatile long wake_total;
+    volatile long wake_max;
 };
 
 struct min_max_report {
@@ -66,11 +200,97 @@ struct min_max_report {
 
 typedef void papi_handler_t(int, void *, long long, void *);
 
-void init_memory(struct memory_state *, int);
+void init_memory(struct memory_state *, struct prog_args *);
+void free_memory(struct memory_state *);
+long huge_page_kb(void);
+void get_page_info(struct memory_state *);
+void print_memory_info(struct memory_state *, int);
+int  numa_num_nodes(void);
+int  numa_current_node(void);
+char *numa_policy_name(int);
+void numa_bind_memory(struct memory_state *, int);
+void numa_locality(struct memory_state *);
+void ring_init(struct ring *, long, long);
+void ring_free(struct ring *);
+int  ring_put(struct ring *, void *);
+int  ring_get(struct ring *, void *);
+char *pin_policy_name(int);
+void parse_pin_policy(struct prog_args *, char *);
+void topology_init(struct prog_args *);
+int  topology_pin(int);
+void topology_check_cpu(int);
+int  topology_last_cpu(int);
+long topology_moves(int);
+void barrier_init(struct barrier *, int);
+int  barrier_wait(struct barrier *);
+void barrier_print(struct barrier *, char *);
+void sampler_start(struct prog_args *, int);
+void sampler_thread_init(int);
+void sampler_record(int, void *, long long);
+int  sampler_stop(void);
+void symtab_load(void);
+long symtab_lookup(void *);
+void symtab_count(void *);
+char *symtab_name(long);
+long symtab_samples(long);
+long symtab_total(void);
+void symtab_reset(void);
+void symtab_print_profile(int);
+char *walk_pattern_name(int);
+void parse_walk_pattern(struct prog_args *, char *);
+char *unwind_mode_name(int);
+void parse_unwind_mode(struct prog_args *, char *);
+void parse_stack_depths(struct prog_args *, char *);
+void unwind_thread_init(int);
+int  unwind_stack(int, int, void *);
 int  run_memory(struct memory_state *, int);
 int  run_flops(int);
 
+struct work_kernel *find_kernel(char *);
+void add_kernels(struct prog_args *, char *);
+void set_default_kernels(struct prog_args *, int);
+void list_kernels(void);
+void print_kernel_list(struct prog_args *);
+void init_kernels(struct prog_args *);
+void init_thread_kernels(struct prog_args *, struct memory_state *);
+int  run_kernels(struct prog_args *, struct memory_state *, int);
+int  kernel_work(struct prog_args *, int);
+float work_secs(struct prog_args *, long);
+char *work_str(struct prog_args *, long, char *, size_t);
+double expected_events(struct prog_args *, char *, long);
+double work_bytes(struct prog_args *, long);
+void calibrate_kernels(struct prog_args *);
+int  kernel_calibrated(struct prog_args *, struct work_kernel *);
+
+/* Kernels defined outside cycles.c. */
+extern struct work_kernel memory_kernel;
+extern struct work_kernel walk_kernel;
+extern struct work_kernel stream_copy_kernel;
+extern struct work_kernel stream_scale_kernel;
+extern struct work_kernel stream_add_kernel;
+extern struct work_kernel stream_triad_kernel;
+extern struct work_kernel share_kernel;
+extern struct work_kernel false_share_kernel;
+extern struct work_kernel recurse_kernel;
+
+#ifdef __x86_64__
+extern struct work_kernel branch_kernel;
+extern struct work_kernel icache_kernel;
+extern struct work_kernel exact_kernel;
+extern struct work_kernel sse_dp_kernel;
+extern struct work_kernel sse_sp_kernel;
+extern struct work_kernel avx_dp_kernel;
+extern struct work_kernel avx_sp_kernel;
+extern struct work_kernel avx512_dp_kernel;
+extern struct work_kernel avx512_sp_kernel;
+struct work_kernel *best_vector_kernel(void);
+#endif
+
 void usage(char *);
+void sort_doubles(double *, long);
+double percentile(double *, long, double);
+void print_latency(char *, double *, long);
+long time_ns(void);
 void set_default_args(struct prog_args *);
 int  parse_args(struct prog_args *, int, char **);
 void get_papi_events(struct prog_args *, int, int, char **);
@@ -125,4 +345,17 @@ random_gen(long x)
     return (x * GEN) % PRIME;
 }
 
+/*
+ *  Xorshift generator with period 2^64 - 1 for large memory mode,
+ *  x must be nonzero.
+ */
+static inline unsigned long
+xorshift_gen(unsigned long x)
+{
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return x;
+}
+
 #endif
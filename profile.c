@@ -0,0 +1,230 @@
+/*
+ *  Flat profile from overflow samples, attributed to functions by the
+ *  ELF symbol tables (see symtab.c).
+ *
+ *  The test runs the -k mix in three phases with different handlers,
+ *  round robin in short slices so that drift in the machine's speed
+ *  affects all three the same:
+ *
+ *    count    count++ only, the baseline
+ *    offline  store the PC in a preallocated array, and look up the
+ *             PCs after the phase
+ *    online   look up the PC and add to the function's count in the
+ *             handler
+ *
+ *  It reports the work rate of each phase, the extra handler cost per
+ *  sample against the baseline, and the cost of the offline lookups.
+ *  Then it prints the flat profile and checks the accuracy: each
+ *  kernel's run function should get its share of the samples, that
+ *  is, its weight in the mix, since every unit of work is calibrated
+ *  to the same time.
+ *
+ *  Copyright (c) 2009-2013, Rice University.
+ *  See the file LICENSE for details.
+ */
+
+#include <sys/time.h>
+#include <sys/types.h>
+#include <err.h>
+#include <error.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <papi.h>
+#include "papi-tests.h"
+
+#define DEFAULT_TIME  30
+#define MIN_TIME       6
+#define DEFAULT_PCS   (1024 * 1024)
+#define PROFILE_TOP   15
+#define NUM_ROUNDS     5
+#define MAX_ERROR     0.10
+
+#define MODE_COUNT    0
+#define MODE_OFFLINE  1
+#define MODE_ONLINE   2
+#define NUM_MODES     3
+
+static char *mode_name[NUM_MODES] = { "count", "offline", "online" };
+
+static struct prog_args args;
+static struct memory_state memstate;
+static int EventSet;
+
+static volatile int mode = MODE_COUNT;
+static volatile long count = 0;
+static void **pcs;
+static long max_pcs;
+static volatile long num_pcs = 0;
+static volatile long dropped = 0;
+
+static float Secs[NUM_MODES];
+static long Samples[NUM_MODES];
+static long Work[NUM_MODES];
+
+void
+my_handler(int EventSet, void *pc, long long ovec, void *context)
+{
+    count++;
+    if (mode == MODE_ONLINE) {
+	symtab_count(pc);
+    }
+    else if (mode == MODE_OFFLINE) {
+	if (num_pcs < max_pcs)
+	    pcs[num_pcs++] = pc;
+	else
+	    dropped++;
+    }
+}
+
+/*
+ *  Run the kernel mix for secs with the handler in mode m and add to
+ *  the totals for m.  Returns: the number of errors.
+ */
+int
+run_phase(int m, float secs)
+{
+    struct timeval start, now;
+    int work, num_errs;
+
+    mode = m;
+    count = 0;
+    num_errs = 0;
+    work = 0;
+
+    gettimeofday(&start, NULL);
+    if (PAPI_start(EventSet) != PAPI_OK)
+	errx(1, "PAPI_start failed");
+    do {
+	num_errs += run_kernels(&args, &memstate, 5);
+	work += kernel_work(&args, 5);
+	gettimeofday(&now, NULL);
+    }
+    while (time_sub(now, start) < secs);
+    PAPI_stop(EventSet, NULL);
+
+    Work[m] += work;
+    Samples[m] += count;
+    Secs[m] += time_sub(now, start);
+
+    return num_errs;
+}
+
+/*
+ *  Returns: the extra handler time per sample (nanosec) in mode m
+ *  compared to the count-only baseline.
+ */
+float
+handler_cost(int m)
+{
+    float base;
+
+    if (Samples[m] == 0 || Work[MODE_COUNT] == 0)
+	return 0.0;
+    base = Work[m] * Secs[MODE_COUNT] / (float) Work[MODE_COUNT];
+    return 1.0e9 * (Secs[m] - base) / Samples[m];
+}
+
+int
+main(int argc, char **argv)
+{
+    struct timeval start, now;
+    float phase_time, lookup_ns, share, expect;
+    char wstr[50];
+    long k, total, kern_samples;
+    int opt, num_errs, total_weight, j, m, r;
+
+    set_default_args(&args);
+    args.prog_time = DEFAULT_TIME;
+    opt = parse_args(&args, argc, argv);
+    get_papi_events(&args, opt, argc, argv);
+    if (args.num_events == 0) {
+	TOT_CYC_DEFAULT(args);
+    }
+    set_default_kernels(&args, 1);
+    args.prog_time = MAX(args.prog_time, MIN_TIME);
+    phase_time = args.prog_time / (float) (NUM_MODES * NUM_ROUNDS);
+
+    printf("Profile test, time: %d\n", args.prog_time);
+    print_event_list(&args);
+    print_kernel_list(&args);
+
+    max_pcs = (args.ring_size > 0) ? args.ring_size : DEFAULT_PCS;
+    pcs = malloc(max_pcs * sizeof(void *));
+    if (pcs == NULL)
+	errx(1, "unable to allocate %ld pcs", max_pcs);
+    for (k = 0; k < max_pcs; k++)
+	pcs[k] = NULL;
+
+    symtab_load();
+    EventSet = event_set_for_overflow(&args, &my_handler);
+    init_kernels(&args);
+    init_thread_kernels(&args, &memstate);
+    printf("\n");
+
+    num_errs = 0;
+    symtab_reset();
+    for (r = 0; r < NUM_ROUNDS; r++) {
+	for (m = 0; m < NUM_MODES; m++) {
+	    num_errs += run_phase(m, phase_time);
+	}
+    }
+    for (m = 0; m < NUM_MODES; m++) {
+	printf("%-8s  time: %.1f, work: %s, samples: %ld, "
+	       "work/sec: %.1f\n", mode_name[m], Secs[m],
+	       work_str(&args, Work[m], wstr, sizeof(wstr)), Samples[m],
+	       Work[m] / MAX(Secs[m], 0.001));
+    }
+    printf("\nhandler cost vs count:  offline: %.0f ns/sample, "
+	   "online: %.0f ns/sample\n\n",
+	   handler_cost(MODE_OFFLINE), handler_cost(MODE_ONLINE));
+
+    symtab_print_profile(PROFILE_TOP);
+
+    /*
+     * Accuracy: each kernel's run function should get its weight's
+     * share of the samples.  This needs calibrated units, so kernels
+     * at their built-in scale are skipped, and so are kernels that run
+     * outside their run function (icache, recurse).
+     */
+    total = symtab_total();
+    total_weight = 0;
+    for (j = 0; j < args.num_kernels; j++) {
+	total_weight += args.weight[j];
+    }
+    printf("\n%-15s  %8s  %8s\n", "kernel", "expected", "actual");
+    for (j = 0; j < args.num_kernels && total > 0; j++) {
+	k = symtab_lookup((void *) args.kernel[j]->run);
+	kern_samples = (k >= 0) ? symtab_samples(k) : 0;
+	share = kern_samples / (float) total;
+	expect = args.weight[j] / (float) total_weight;
+	printf("%-15s  %7.1f%%  %7.1f%%\n", args.kernel[j]->name,
+	       100.0 * expect, 100.0 * share);
+	if (args.kernel[j] == &recurse_kernel)
+	    continue;
+#ifdef __x86_64__
+	if (args.kernel[j] == &icache_kernel)
+	    continue;
+#endif
+	if (kernel_calibrated(&args, args.kernel[j]) && k >= 0
+	    && (share < expect - MAX_ERROR || share > expect + MAX_ERROR)) {
+	    warnx("kernel %s: %.1f%% of samples, expected %.1f%%",
+		  args.kernel[j]->name, 100.0 * share, 100.0 * expect);
+	    num_errs++;
+	}
+    }
+
+    /* Resolve the offline PCs, this is the offline lookup cost. */
+    symtab_reset();
+    gettimeofday(&start, NULL);
+    for (k = 0; k < num_pcs; k++) {
+	symtab_count(pcs[k]);
+    }
+    gettimeofday(&now, NULL);
+    lookup_ns = 1.0e9 * time_sub(now, start) / (float) MAX(num_pcs, 1);
+    printf("\noffline lookup: %.0f ns/sample, %ld pcs, %ld dropped\n",
+	   lookup_ns, num_pcs, dropped);
+
+    EXIT_PASS_FAIL(num_errs == 0 && Samples[MODE_ONLINE] > 0);
+}
@@ -0,0 +1,94 @@
+/*
+ *  Lock-free, single producer, single consumer ring buffer.
+ *
+ *  The producer is an overflow handler (or anything else that can't
+ *  take a lock or call malloc), so the buffer is preallocated and
+ *  ring_put() only copies the element and moves the head.  If the
+ *  ring is full, the element is dropped and counted, the producer
+ *  never waits.  The consumer is a normal thread that drains the ring
+ *  with ring_get().
+ *
+ *  The head is written only by the producer and the tail only by the
+ *  consumer.  The release store on one side pairs with the acquire
+ *  load on the other, so the element copy is visible before the index
+ *  that publishes it.
+ *
+ *  Copyright (c) 2009-2013, Rice University.
+ *  See the file LICENSE for details.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "papi-tests.h"
+
+/*
+ *  Size is rounded up to a power of 2 so the index wraps with a mask.
+ */
+void
+ring_init(struct ring *ring, long size, long elem_size)
+{
+    long len;
+
+    for (len = 1; len < size; len *= 2)
+	;
+    ring->buf = malloc(len * elem_size);
+    if (ring->buf == NULL) {
+	errx(1, "%s: unable to allocate %ld x %ld bytes",
+	     __func__, len, elem_size);
+    }
+    /* Touch the pages now, not in the handler. */
+    memset(ring->buf, 0, len * elem_size);
+    ring->elem_size = elem_size;
+    ring->mask = len - 1;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->drops = 0;
+}
+
+void
+ring_free(struct ring *ring)
+{
+    free(ring->buf);
+    ring->buf = NULL;
+}
+
+/*
+ *  Producer side, async signal safe.  Returns: 1 if the element was
+ *  added, or 0 if the ring was full and the element dropped.
+ */
+int
+ring_put(struct ring *ring, void *elem)
+{
+    long head = ring->head;
+
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) > ring->mask) {
+	ring->drops++;
+	return 0;
+    }
+    memcpy(ring->buf + (head & ring->mask) * ring->elem_size, elem,
+	   ring->elem_size);
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+    return 1;
+}
+
+/*
+ *  Consumer side.  Returns: 1 if an element was copied to elem, or 0
+ *  if the ring is empty.
+ */
+int
+ring_get(struct ring *ring, void *elem)
+{
+    long tail = ring->tail;
+
+    if (tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE))
+	return 0;
+    memcpy(elem, ring->buf + (tail & ring->mask) * ring->elem_size,
+	   ring->elem_size);
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+
+    return 1;
+}
@@ -0,0 +1,185 @@
+/*
+ *  Record a sample for each interrupt in a per-thread ring, the way a
+ *  real sampling profiler does, instead of just count++.
+ *
+ *  With -R size, the overflow handlers call sampler_record() with the
+ *  PC and overflow vector, which adds the PC, timestamp, overflow
+ *  vector and kernel thread id to the thread's ring (see ring.c).  Each
+ *  thread calls sampler_thread_init() to claim its ring.  A consumer
+ *  thread drains the rings without locks and checks the contents:
+ *  each sample must come from the thread that owns the ring, have a
+ *  nonzero PC and overflow vector, and the timestamps in each ring must
+ *  not go backwards.  Samples that arrive when the ring is full are dropped
+ *  and counted.
+ *
+ *  Copyright (c) 2009-2013, Rice University.
+ *  See the file LICENSE for details.
+ */
+
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "papi-tests.h"
+
+#define SAMPLER_POLL_USEC  1000
+#define MAX_WARNINGS  10
+
+struct sample {
+    void *pc;
+    long long ovec;
+    long time;
+    int tid;
+};
+
+static struct ring sample_ring[MAX_THREADS];
+static long last_time[MAX_THREADS];
+static volatile int owner[MAX_THREADS];
+static int num_rings = 0;
+
+static pthread_t consumer;
+static volatile int stop = 0;
+
+static long num_samples = 0;
+static long num_bad = 0;
+static long max_fill = 0;
+
+static void
+check_sample(int ring, struct sample *s)
+{
+    char *why = NULL;
+
+    num_samples++;
+    if (s->tid != owner[ring])
+	why = "wrong thread";
+    else if (s->pc == NULL)
+	why = "null pc";
+    else if (s->ovec == 0)
+	why = "empty overflow vector";
+    else if (s->time < last_time[ring])
+	why = "time went backwards";
+    last_time[ring] = s->time;
+
+    if (why != NULL) {
+	num_bad++;
+	if (num_bad <= MAX_WARNINGS) {
+	    warnx("bad sample in ring %d: %s (tid: %d, owner: %d, pc: %p, "
+		  "ovec: 0x%llx)", ring, why, s->tid, owner[ring], s->pc, s->ovec);
+	}
+    }
+}
+
+/*
+ *  Drain every ring, returns: number of samples.
+ */
+static long
+drain_rings(void)
+{
+    struct sample s;
+    long num, fill;
+    int k;
+
+    num = 0;
+    for (k = 0; k < num_rings; k++) {
+	fill = sample_ring[k].head - sample_ring[k].tail;
+	max_fill = MAX(max_fill, fill);
+	while (ring_get(&sample_ring[k], &s)) {
+	    check_sample(k, &s);
+	    num++;
+	}
+    }
+    return num;
+}
+
+static void *
+consumer_thread(void *data)
+{
+    while (! stop) {
+	if (drain_rings() == 0)
+	    usleep(SAMPLER_POLL_USEC);
+    }
+    return NULL;
+}
+
+/*
+ *  Allocate one ring of args->ring_size samples per thread and start
+ *  the consumer.  Call before PAPI_start().
+ */
+void
+sampler_start(struct prog_args *args, int num_threads)
+{
+    int k;
+
+    num_rings = MIN(num_threads, MAX_THREADS);
+    for (k = 0; k < num_rings; k++) {
+	ring_init(&sample_ring[k], args->ring_size, sizeof(struct sample));
+	last_time[k] = 0;
+	owner[k] = 0;
+    }
+    stop = 0;
+    if (pthread_create(&consumer, NULL, consumer_thread, NULL) != 0)
+	errx(1, "pthread create failed");
+}
+
+/*
+ *  Make the calling thread the owner of ring tid.  Call in that thread
+ *  after sampler_start() and before its PAPI_start().
+ */
+void
+sampler_thread_init(int tid)
+{
+    if (tid >= 0 && tid < num_rings)
+	owner[tid] = syscall(SYS_gettid);
+}
+
+/*
+ *  Called from the overflow handler, async signal safe.
+ */
+void
+sampler_record(int tid, void *pc, long long ovec)
+{
+    struct sample s;
+
+    if (tid < 0 || tid >= num_rings)
+	return;
+
+    s.pc = pc;
+    s.ovec = ovec;
+    s.time = time_ns();
+    s.tid = syscall(SYS_gettid);
+    ring_put(&sample_ring[tid], &s);
+}
+
+/*
+ *  Stop the consumer, drain what's left and print the totals.
+ *  Returns: the number of bad samples.
+ */
+int
+sampler_stop(void)
+{
+    long drops, size;
+    int k;
+
+    stop = 1;
+    pthread_join(consumer, NULL);
+    drain_rings();
+
+    drops = 0;
+    size = (num_rings > 0) ? sample_ring[0].mask + 1 : 0;
+    for (k = 0; k < num_rings; k++) {
+	drops += sample_ring[k].drops;
+	ring_free(&sample_ring[k]);
+    }
+    printf("samples: %ld, dropped: %ld (%.2f%%), bad: %ld, "
+	   "max ring fill: %ld of %ld\n",
+	   num_samples, drops,
+	   100.0 * drops / (float) MAX(num_samples + drops, 1),
+	   num_bad, max_fill, size);
+
+    return num_bad;
+}
@@ -0,0 +1,325 @@
+/*
+ *  Latency of setting up and reprogramming an EventSet.
+ *
+ *  thread-over calls PAPI_overflow() again for every threshold and
+ *  throttle builds a new EventSet at every step.  This test times
+ *  each of those calls, the way an application that changes its
+ *  sampling at run time would make them:
+ *
+ *    create     PAPI_create_eventset()
+ *    add        PAPI_add_event(), per event
+ *    overflow   PAPI_overflow() on the first event
+ *    start      PAPI_start()
+ *    stop       PAPI_stop(), after -w units of work
+ *    threshold  PAPI_overflow() again with a new threshold
+ *    destroy    PAPI_cleanup_eventset() and PAPI_destroy_eventset()
+ *
+ *  The test repeats the cycle NUM_ITERS times in each thread, for 1 up
+ *  to all the events on the command line, and for each thread count
+ *  in -T (default 1 and -p).  All threads run the cycle at the same
+ *  time, so the calls contend with each other the way they would in
+ *  a threaded application.
+ *
+ *  Copyright (c) 2009-2013, Rice University.
+ *  See the file LICENSE for details.
+ */
+
+#include <sys/time.h>
+#include <sys/types.h>
+#include <err.h>
+#include <error.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <papi.h>
+#include "papi-tests.h"
+
+#define DEFAULT_UNITS     1
+#define NUM_ITERS       200
+#define MAX_RECORDS  100000
+#define MAX_POINTS   (MAX_SWEEP * MAX_EVENTS)
+
+#define OP_CREATE     0
+#define OP_ADD        1
+#define OP_OVERFLOW   2
+#define OP_START      3
+#define OP_STOP       4
+#define OP_THRESHOLD  5
+#define OP_DESTROY    6
+#define NUM_OPS       7
+
+static char *op_name[NUM_OPS] = {
+    "create", "add", "overflow", "start", "stop", "threshold", "destroy",
+};
+
+static struct prog_args args;
+static struct memory_state memstate[MAX_THREADS];
+static int have_memstate[MAX_THREADS];
+static struct barrier start_barrier;
+
+static double Lat[NUM_OPS][MAX_RECORDS];
+static volatile long num_lat[NUM_OPS];
+
+static int Threads[MAX_SWEEP];
+static int num_thread_counts;
+static int cur_events;
+
+static float P50[MAX_POINTS][NUM_OPS];
+static float P99[MAX_POINTS][NUM_OPS];
+static int PointThreads[MAX_POINTS];
+static int PointEvents[MAX_POINTS];
+
+static volatile long count = 0;
+static volatile int num_errs = 0;
+
+static void
+record(int op, long start, long end)
+{
+    long n = __sync_fetch_and_add(&num_lat[op], 1);
+
+    if (n < MAX_RECORDS)
+	Lat[op][n] = (end - start) / 1000.0;
+}
+
+void
+my_handler(int EventSet, void *pc, long long ovec, void *context)
+{
+    count++;
+}
+
+void *
+setup_thread(void *data)
+{
+    int tid = *(int *)data;
+    int EventSet, iter, k, n, thresh;
+    long t0, t1;
+    char name[500];
+
+    if (PAPI_register_thread() != PAPI_OK) {
+	errx(1, "PAPI_register_thread failed");
+    }
+    if (! have_memstate[tid]) {
+	memstate[tid].tid = tid;
+	init_thread_kernels(&args, &memstate[tid]);
+	have_memstate[tid] = 1;
+    }
+    barrier_wait(&start_barrier);
+
+    for (iter = 0; iter < NUM_ITERS; iter++) {
+	EventSet = PAPI_NULL;
+	t0 = time_ns();
+	if (PAPI_create_eventset(&EventSet) != PAPI_OK) {
+	    errx(1, "PAPI_create_eventset failed");
+	}
+	t1 = time_ns();
+	record(OP_CREATE, t0, t1);
+
+	for (k = 0; k < cur_events; k++) {
+	    t0 = time_ns();
+	    if (PAPI_add_event(EventSet, args.event[k]) != PAPI_OK) {
+		PAPI_event_code_to_name(args.event[k], name);
+		errx(1, "PAPI_add_event failed: %s", name);
+	    }
+	    t1 = time_ns();
+	    record(OP_ADD, t0, t1);
+	}
+
+	t0 = time_ns();
+	if (PAPI_overflow(EventSet, args.event[0], args.threshold[0], 0,
+			  my_handler) != PAPI_OK) {
+	    errx(1, "PAPI_overflow failed: %s", args.name[0]);
+	}
+	t1 = time_ns();
+	record(OP_OVERFLOW, t0, t1);
+
+	t0 = time_ns();
+	if (PAPI_start(EventSet) != PAPI_OK) {
+	    errx(1, "PAPI_start failed");
+	}
+	t1 = time_ns();
+	record(OP_START, t0, t1);
+
+	n = run_kernels(&args, &memstate[tid], args.work);
+	if (n > 0) {
+	    __sync_fetch_and_add(&num_errs, n);
+	}
+
+	t0 = time_ns();
+	if (PAPI_stop(EventSet, NULL) != PAPI_OK) {
+	    warnx("PAPI_stop failed");
+	}
+	t1 = time_ns();
+	record(OP_STOP, t0, t1);
+
+	/* The EventSet must be stopped to change the threshold. */
+	thresh = (iter % 2 == 0) ? 2 * args.threshold[0] : args.threshold[0];
+	t0 = time_ns();
+	if (PAPI_overflow(EventSet, args.event[0], thresh, 0,
+			  my_handler) != PAPI_OK) {
+	    errx(1, "PAPI_overflow failed: %s@%d", args.name[0], thresh);
+	}
+	t1 = time_ns();
+	record(OP_THRESHOLD, t0, t1);
+
+	t0 = time_ns();
+	if (PAPI_cleanup_eventset(EventSet) != PAPI_OK) {
+	    warnx("PAPI_cleanup_eventset failed");
+	}
+	if (PAPI_destroy_eventset(&EventSet) != PAPI_OK) {
+	    warnx("PAPI_destroy_eventset failed");
+	}
+	t1 = time_ns();
+	record(OP_DESTROY, t0, t1);
+    }
+
+    PAPI_unregister_thread();
+    return NULL;
+}
+
+/*
+ *  Run one point with num_threads threads and the first num_events
+ *  events, print the latency table and save p50 and p99.
+ */
+void
+run_point(int point, int num_threads, int num_events)
+{
+    pthread_t td[MAX_THREADS];
+    int tid[MAX_THREADS];
+    double *lat;
+    long num;
+    int k, op;
+
+    printf("\nthreads: %d, events: %d (", num_threads, num_events);
+    for (k = 0; k < num_events; k++) {
+	printf("%s%s", (k > 0) ? " " : "", args.name[k]);
+    }
+    printf(")\n");
+
+    cur_events = num_events;
+    for (op = 0; op < NUM_OPS; op++) {
+	num_lat[op] = 0;
+    }
+    barrier_init(&start_barrier, num_threads);
+
+    for (k = 0; k < num_threads; k++) {
+	tid[k] = k;
+	if (pthread_create(&td[k], NULL, setup_thread, &tid[k]) != 0)
+	    errx(1, "pthread create failed");
+    }
+    for (k = 0; k < num_threads; k++) {
+	pthread_join(td[k], NULL);
+    }
+
+    printf("%-14s  %8s  %8s  %8s  %8s  %8s  %8s\n", "latency (usec)",
+	   "count", "min", "p50", "p90", "p99", "max");
+    for (op = 0; op < NUM_OPS; op++) {
+	lat = Lat[op];
+	num = MIN(num_lat[op], MAX_RECORDS);
+	print_latency(op_name[op], lat, num);
+	P50[point][op] = percentile(lat, num, 50.0);
+	P99[point][op] = percentile(lat, num, 99.0);
+    }
+    PointThreads[point] = num_threads;
+    PointEvents[point] = num_events;
+}
+
+void
+print_summary(char *title, float table[MAX_POINTS][NUM_OPS], int num_points)
+{
+    int p, op;
+
+    printf("%s (usec)\n%7s  %6s", title, "threads", "events");
+    for (op = 0; op < NUM_OPS; op++) {
+	printf("  %9s", op_name[op]);
+    }
+    printf("\n");
+
+    for (p = 0; p < num_points; p++) {
+	printf("%7d  %6d", PointThreads[p], PointEvents[p]);
+	for (op = 0; op < NUM_OPS; op++) {
+	    printf("  %9.1f", table[p][op]);
+	}
+	printf("\n");
+    }
+    printf("\n");
+}
+
+/*
+ *  Add PAPI_TOT_INS and PAPI_BR_INS, if available, when there is only
+ *  the one default event.
+ */
+void
+add_default_events(void)
+{
+    static char *more_names[] = { "PAPI_TOT_INS", "PAPI_BR_INS" };
+    int k, ev;
+
+    for (k = 0; k < sizeof(more_names) / sizeof(char *); k++) {
+	if (PAPI_event_name_to_code(more_names[k], &ev) == PAPI_OK
+	    && ev != args.event[0] && PAPI_query_event(ev) == PAPI_OK) {
+	    args.name[args.num_events] = more_names[k];
+	    args.event[args.num_events] = ev;
+	    args.threshold[args.num_events] = 0;
+	    args.num_events++;
+	}
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    int k, n, opt, num_points;
+
+    set_default_args(&args);
+    args.work = DEFAULT_UNITS;
+    opt = parse_args(&args, argc, argv);
+    get_papi_events(&args, opt, argc, argv);
+    if (args.num_events == 0) {
+	TOT_CYC_DEFAULT(args);
+	add_default_events();
+    }
+    set_default_kernels(&args, 0);
+
+    /* Thread counts from -T, else 1 and -p. */
+    num_thread_counts = 0;
+    if (args.num_sweep > 0) {
+	for (k = 0; k < args.num_sweep; k++)
+	    Threads[num_thread_counts++] = args.sweep[k];
+    }
+    else {
+	Threads[num_thread_counts++] = 1;
+	if (args.num_threads > 1)
+	    Threads[num_thread_counts++] = args.num_threads;
+    }
+    for (k = 0; k < num_thread_counts; k++) {
+	if (Threads[k] > MAX_THREADS)
+	    errx(1, "too many threads: %d", Threads[k]);
+    }
+
+    printf("EventSet Setup Latency Test, iterations: %d, work: %d units\n",
+	   NUM_ITERS, args.work);
+    print_event_list(&args);
+    print_kernel_list(&args);
+    init_kernels(&args);
+
+    if (PAPI_thread_init(pthread_self) != PAPI_OK) {
+	errx(1, "PAPI_thread_init failed");
+    }
+
+    num_points = 0;
+    for (k = 0; k < num_thread_counts; k++) {
+	for (n = 1; n <= args.num_events; n++) {
+	    run_point(num_points, Threads[k], n);
+	    num_points++;
+	}
+    }
+
+    printf("\nEventSet Setup Latency Test, samples: %ld\n\n", count);
+    print_summary("p50 latency", P50, num_points);
+    print_summary("p99 latency", P99, num_points);
+
+    EXIT_PASS_FAIL(num_errs == 0);
+}
@@ -0,0 +1,132 @@
+/*
+ *  Kernels for cache coherence traffic between threads.
+ *
+ *  The other kernels only touch thread-private memory.  Here, the
+ *  threads are split into groups of -g threads (default all threads
+ *  in one group) and the threads in each group hammer on one cache
+ *  line:
+ *
+ *    share        atomic adds to one shared counter (true sharing)
+ *    false-share  plain adds to each thread's own counter, all in
+ *                 the same line (false sharing)
+ *
+ *  Either way, the line bounces between the cores in the group, which
+ *  makes HITM type events and changes the cost of each interrupt.
+ *  With -g 1, each thread has its own line as a baseline.  False
+ *  sharing fits at most 8 counters in one line, so -g is at most 8.
+ *
+ *  Copyright (c) 2009-2013, Rice University.
+ *  See the file LICENSE for details.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "papi-tests.h"
+
+#define LINE_SIZE     64
+#define LINE_LONGS    (LINE_SIZE / sizeof(long))
+#define SHARE_SCALE   200000
+
+static volatile long *share_lines = NULL;
+static int share_degree;
+
+/*
+ *  Allocate one line per group, once per process.
+ */
+static void
+share_init(struct prog_args *args)
+{
+    void *ptr;
+
+    if (share_lines != NULL)
+	return;
+
+    share_degree = args->share_degree;
+    if (share_degree <= 0)
+	share_degree = MAX(args->num_threads, 1);
+
+    if (posix_memalign(&ptr, LINE_SIZE, MAX_THREADS * LINE_SIZE) != 0) {
+	errx(1, "%s: out of memory", __func__);
+    }
+    memset(ptr, 0, MAX_THREADS * LINE_SIZE);
+    share_lines = ptr;
+}
+
+static void
+false_share_init(struct prog_args *args)
+{
+    share_init(args);
+    if (share_degree > LINE_LONGS) {
+	errx(1, "false-share fits at most %d threads per line, use -g",
+	     (int) LINE_LONGS);
+    }
+}
+
+/*
+ *  Each unit is scale atomic adds.  Other threads add to the same
+ *  counter, so it must go up by at least our share.
+ */
+static int
+share_run(struct memory_state *mstate, int work)
+{
+    volatile long *ctr;
+    long n, before;
+    int num_errs = 0;
+
+    ctr = &share_lines[(mstate->tid / share_degree) * LINE_LONGS];
+    for (; work > 0; work--) {
+	before = *ctr;
+	for (n = 0; n < share_kernel.scale; n++) {
+	    __sync_fetch_and_add(ctr, 1);
+	}
+	if (*ctr - before < share_kernel.scale) {
+	    warnx("%s: counter is out of range: %ld", __func__, *ctr - before);
+	    num_errs++;
+	}
+    }
+
+    return (num_errs);
+}
+
+/*
+ *  Each unit is scale plain adds to our own counter, which no other
+ *  thread writes, so it goes up by exactly scale.
+ */
+static int
+false_share_run(struct memory_state *mstate, int work)
+{
+    volatile long *ctr;
+    long n, before;
+    int num_errs = 0;
+
+    ctr = &share_lines[(mstate->tid / share_degree) * LINE_LONGS
+		       + mstate->tid % share_degree];
+    for (; work > 0; work--) {
+	before = *ctr;
+	for (n = 0; n < false_share_kernel.scale; n++) {
+	    *ctr += 1;
+	}
+	if (*ctr - before != false_share_kernel.scale) {
+	    warnx("%s: counter is out of range: %ld", __func__, *ctr - before);
+	    num_errs++;
+	}
+    }
+
+    return (num_errs);
+}
+
+struct work_kernel share_kernel = {
+    "share", "atomic adds to a line shared by -g threads",
+    "PAPI_CA_SHR PAPI_CA_ITV PAPI_CA_INV PAPI_CA_SNP",
+    share_init, NULL, NULL, share_run, SHARE_SCALE, 0, 0, 0, 0, 0,
+};
+
+struct work_kernel false_share_kernel = {
+    "false-share", "adds to private counters in a line of -g threads",
+    "PAPI_CA_SHR PAPI_CA_ITV PAPI_CA_INV PAPI_CA_SNP",
+    false_share_init, NULL, NULL, false_share_run, SHARE_SCALE,
+    0, 0, 0, 0, 0,
+};
@@ -0,0 +1,137 @@
+/*
+ *  Vector flop kernels: SSE2, AVX and AVX-512, in single and double
+ *  precision.
+ *
+ *  Each iteration does one packed multiply and one packed add on each
+ *  of SIMD_ACC independent accumulators, so the number of flops per
+ *  iteration is exactly 2 * SIMD_ACC * lanes, with no scalar flops in
+ *  the loop.  The Makefile builds this file with -ffp-contract=off so
+ *  the compiler can't fuse the multiply and add into one FMA.  The
+ *  'vector' kernel picks the widest double precision version that the
+ *  CPU supports (by CPUID) at runtime.
+ *
+ *  The accumulators iterate x = x * 0.5 + 1.0, which converges to 2.0,
+ *  so we can check the results without overflow or denormals.
+ *
+ *  Copyright (c) 2009-2013, Rice University.
+ *  See the file LICENSE for details.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include "papi-tests.h"
+
+#ifdef __x86_64__
+
+#include <immintrin.h>
+
+#define SIMD_ACC    4
+#define SIMD_SCALE  100000
+
+/*
+ *  Generate the init and run functions and the kernel struct for one
+ *  vector type.  The values are stored back to memory only at the end
+ *  of each unit to check them.
+ */
+#define SIMD_KERNEL(NAME, STR, FEATURE, VEC, ELEM, LANES,		\
+		    SET1, MUL, ADD, STORE, DESC, EVENTS)		\
+struct work_kernel NAME##_kernel;					\
+									\
+static void								\
+NAME##_init(struct prog_args *args)					\
+{									\
+    if (! __builtin_cpu_supports(FEATURE))				\
+	errx(1, "kernel %s requires %s, not supported on this CPU",	\
+	     STR, FEATURE);						\
+}									\
+									\
+__attribute__((target(FEATURE))) static int				\
+NAME##_run(struct memory_state *mstate, int work)			\
+{									\
+    VEC x0, x1, x2, x3, half, one;					\
+    ELEM val[SIMD_ACC * LANES];						\
+    long k, n;								\
+    int num_errs = 0;							\
+									\
+    half = SET1(0.5);							\
+    one = SET1(1.0);							\
+    for (; work > 0; work--) {						\
+	x0 = SET1(0.0);							\
+	x1 = SET1(1.0);							\
+	x2 = SET1(3.0);							\
+	x3 = SET1(4.0);							\
+	for (k = 0; k < NAME##_kernel.scale; k++) {			\
+	    x0 = ADD(MUL(x0, half), one);				\
+	    x1 = ADD(MUL(x1, half), one);				\
+	    x2 = ADD(MUL(x2, half), one);				\
+	    x3 = ADD(MUL(x3, half), one);				\
+	}								\
+	STORE(&val[0 * LANES], x0);					\
+	STORE(&val[1 * LANES], x1);					\
+	STORE(&val[2 * LANES], x2);					\
+	STORE(&val[3 * LANES], x3);					\
+	for (n = 0; n < SIMD_ACC * LANES; n++) {			\
+	    if (val[n] < 1.99 || val[n] > 2.01) {			\
+		warnx("%s: value is out of range: %g", STR,		\
+		      (double) val[n]);					\
+		num_errs++;						\
+		break;							\
+	    }								\
+	}								\
+    }									\
+    return (num_errs);							\
+}									\
+									\
+struct work_kernel NAME##_kernel = {					\
+    STR, DESC, EVENTS,							\
+    NAME##_init, NULL, NULL, NAME##_run, SIMD_SCALE,			\
+    0, 0, 2 * SIMD_ACC, 2 * SIMD_ACC * LANES, 0,			\
+};
+
+SIMD_KERNEL(sse_dp, "sse-dp", "sse2", __m128d, double, 2,
+	    _mm_set1_pd, _mm_mul_pd, _mm_add_pd, _mm_storeu_pd,
+	    "SSE2 packed double mult, add (16 flops/iter)",
+	    "PAPI_VEC_DP PAPI_FP_OPS PAPI_DP_OPS")
+
+SIMD_KERNEL(sse_sp, "sse-sp", "sse2", __m128, float, 4,
+	    _mm_set1_ps, _mm_mul_ps, _mm_add_ps, _mm_storeu_ps,
+	    "SSE packed single mult, add (32 flops/iter)",
+	    "PAPI_VEC_SP PAPI_FP_OPS PAPI_SP_OPS")
+
+SIMD_KERNEL(avx_dp, "avx-dp", "avx", __m256d, double, 4,
+	    _mm256_set1_pd, _mm256_mul_pd, _mm256_add_pd, _mm256_storeu_pd,
+	    "AVX 256-bit packed double mult, add (32 flops/iter)",
+	    "PAPI_VEC_DP PAPI_FP_OPS PAPI_DP_OPS")
+
+SIMD_KERNEL(avx_sp, "avx-sp", "avx", __m256, float, 8,
+	    _mm256_set1_ps, _mm256_mul_ps, _mm256_add_ps, _mm256_storeu_ps,
+	    "AVX 256-bit packed single mult, add (64 flops/iter)",
+	    "PAPI_VEC_SP PAPI_FP_OPS PAPI_SP_OPS")
+
+SIMD_KERNEL(avx512_dp, "avx512-dp", "avx512f", __m512d, double, 8,
+	    _mm512_set1_pd, _mm512_mul_pd, _mm512_add_pd, _mm512_storeu_pd,
+	    "AVX-512 packed double mult, add (64 flops/iter)",
+	    "PAPI_VEC_DP PAPI_FP_OPS PAPI_DP_OPS")
+
+SIMD_KERNEL(avx512_sp, "avx512-sp", "avx512f", __m512, float, 16,
+	    _mm512_set1_ps, _mm512_mul_ps, _mm512_add_ps, _mm512_storeu_ps,
+	    "AVX-512 packed single mult, add (128 flops/iter)",
+	    "PAPI_VEC_SP PAPI_FP_OPS PAPI_SP_OPS")
+
+/*
+ *  The 'vector' kernel is an alias for the widest double precision
+ *  kernel that this CPU supports.
+ */
+struct work_kernel *
+best_vector_kernel(void)
+{
+    if (__builtin_cpu_supports("avx512f"))
+	return &avx512_dp_kernel;
+    if (__builtin_cpu_supports("avx"))
+	return &avx_dp_kernel;
+    return &sse_dp_kernel;
+}
+
+#endif
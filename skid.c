@@ -0,0 +1,457 @@
+/*
+ *  Measure the skid of the PC that PAPI_overflow() passes to the
+ *  handler, in instructions and bytes.
+ *
+ *  context.c checks the PC against four large ranges, which hides
+ *  skid of a few instructions.  Here, each sequence is a run of
+ *  identical asm blocks, one trigger instruction followed by a sled of
+ *  SLED_INS instructions that don't trigger the event:
+ *
+ *    branch  jnc (always taken)    PAPI_BR_*, BR_*
+ *    load    mov from memory       PAPI_LD_INS, PAPI_L1_DCA, MEM_*
+ *    fp      addsd                 PAPI_FP_*, PAPI_DP_OPS, FP_*
+ *
+ *  The sled is 4-byte adds to a register.  For an event that counts
+ *  only the trigger, the overflow happens on a trigger, so the offset
+ *  of the PC from the start of its block is the skid: 0 is the
+ *  trigger itself, 1 is the next instruction, etc.  Skid of more than
+ *  SLED_INS instructions wraps into the next block.  The loop branch
+ *  at the end of each pass also counts as a branch, about 1 in
+ *  SKID_BLOCKS samples for the branch sequence.
+ *
+ *  Each event runs on its own for an equal share of the time.  For a
+ *  native event without a precise modifier, the test also runs the
+ *  :precise=1,2,3 variants that PAPI accepts (perf_events PEBS/IBS),
+ *  so the skid can be compared side by side.  PAPI presets don't take
+ *  modifiers.  Events with no trigger in the table (eg, cycles) run on
+ *  the branch sequence and show the spread of the PC over the block.
+ *
+ *  This is raw x86-64 asm, so it is x86-64 only.
+ *
+ *  Copyright (c) 2009-2013, Rice University.
+ *  See the file LICENSE for details.
+ */
+
+#include <sys/time.h>
+#include <sys/types.h>
+#include <err.h>
+#include <error.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <papi.h>
+#include "papi-tests.h"
+
+#ifdef __x86_64__
+
+#define DEFAULT_TIME       20
+#define DEFAULT_OVERFLOW   100003
+#define MIN_RUN_TIME       1.0
+#define SEQ_ITER           200
+#define MIN_SAMPLES        50
+#define MIN_IN_SEQ         0.80
+#define MAX_PRECISE        3
+#define MAX_RUNS           (4 * MAX_EVENTS)
+#define MAX_HIST_INS       8
+
+#define SKID_BLOCKS  64
+#define SLED_INS     64
+#define SLED_BYTES   4
+
+#define STR(x)   #x
+#define XSTR(x)  STR(x)
+
+#define SLED  \
+    ".rept " XSTR(SLED_INS) "\n\tadd $1, %%rcx\n\t.endr\n\t"
+
+/*
+ *  One sequence: the first block has labels for the trigger and the
+ *  sled, then SKID_BLOCKS - 1 more blocks, repeated n times.
+ */
+#define SKID_SEQ(name, trigger)				\
+    "clc\n"						\
+    "8:\n\t"						\
+    ".globl  skid_" name "_start\n"			\
+    "skid_" name "_start:\n\t"				\
+    trigger "\n\t"					\
+    ".globl  skid_" name "_sled\n"			\
+    "skid_" name "_sled:\n\t"				\
+    SLED						\
+    ".rept " XSTR(SKID_BLOCKS - 1) "\n\t"		\
+    trigger "\n\t"					\
+    SLED						\
+    ".endr\n"						\
+    ".globl  skid_" name "_end\n"			\
+    "skid_" name "_end:\n\t"				\
+    "dec  %[n]\n\t"					\
+    "jnz  8b\n\t"
+
+extern char skid_branch_start, skid_branch_sled, skid_branch_end;
+extern char skid_load_start, skid_load_sled, skid_load_end;
+extern char skid_fp_start, skid_fp_sled, skid_fp_end;
+
+#define SEQ_BRANCH  0
+#define SEQ_LOAD    1
+#define SEQ_FP      2
+#define NUM_SEQS    3
+
+struct sequence {
+    char *name;
+    void (*run)(long);
+    char *start;
+    char *sled;
+    char *end;
+    long trig_len;
+    long block_size;
+};
+
+/*
+ *  Map event names to the sequence with their trigger, by prefix.
+ */
+static struct {
+    char *prefix;
+    int seq;
+} trigger_table[] = {
+    { "PAPI_BR_", SEQ_BRANCH },
+    { "BR_",      SEQ_BRANCH },
+    { "PAPI_LD_INS", SEQ_LOAD },
+    { "PAPI_L1_DCA", SEQ_LOAD },
+    { "MEM_",     SEQ_LOAD },
+    { "PAPI_FP_", SEQ_FP },
+    { "PAPI_DP_OPS", SEQ_FP },
+    { "FP_",      SEQ_FP },
+    { NULL, 0 },
+};
+
+struct run {
+    char *name;
+    int event;
+    int threshold;
+    int seq;
+    int has_trigger;
+    int variant;
+    long samples;
+    long outside;
+    long hist[SLED_INS + 2];
+    long bytes;
+};
+
+static struct prog_args args;
+static struct sequence seq_list[NUM_SEQS];
+static struct run run_list[MAX_RUNS];
+static int num_runs = 0;
+
+static struct run *volatile cur_run = NULL;
+static struct sequence *volatile cur_seq = NULL;
+
+static void __attribute__ ((noinline))
+run_branch(long n)
+{
+    asm volatile (
+	SKID_SEQ("branch", "jnc  1f\n1:")
+	: [n] "+r" (n)
+	:
+	: "rcx", "cc");
+}
+
+static void __attribute__ ((noinline))
+run_load(long n)
+{
+    long val = 1;
+
+    asm volatile (
+	SKID_SEQ("load", "mov  (%[p]), %%rax")
+	: [n] "+r" (n)
+	: [p] "r" (&val)
+	: "rax", "rcx", "cc", "memory");
+}
+
+static void __attribute__ ((noinline))
+run_fp(long n)
+{
+    asm volatile (
+	SKID_SEQ("fp", "addsd  %%xmm1, %%xmm0")
+	: [n] "+r" (n)
+	:
+	: "rcx", "xmm0", "xmm1", "cc");
+}
+
+static void
+init_sequence(int k, char *name, void (*run)(long),
+	      char *start, char *sled, char *end)
+{
+    struct sequence *seq = &seq_list[k];
+
+    seq->name = name;
+    seq->run = run;
+    seq->start = start;
+    seq->sled = sled;
+    seq->end = end;
+    seq->trig_len = sled - start;
+    seq->block_size = seq->trig_len + SLED_INS * SLED_BYTES;
+
+    if (end - start != SKID_BLOCKS * seq->block_size) {
+	errx(1, "unexpected layout for %s sequence: %ld bytes, expected %ld",
+	     name, (long) (end - start), SKID_BLOCKS * seq->block_size);
+    }
+}
+
+/*
+ *  Put the PC's offset in its block into the histogram: 0 for the
+ *  trigger, 1 + n for the n-th sled instruction.
+ */
+void
+my_handler(int EventSet, void *pc, long long ovec, void *context)
+{
+    struct run *run = cur_run;
+    struct sequence *seq = cur_seq;
+    long off, ins;
+
+    if (run == NULL || seq == NULL)
+	return;
+
+    run->samples++;
+    if ((char *) pc < seq->start || (char *) pc >= seq->end) {
+	run->outside++;
+	return;
+    }
+    off = ((char *) pc - seq->start) % seq->block_size;
+    if (off < seq->trig_len)
+	ins = 0;
+    else
+	ins = 1 + (off - seq->trig_len) / SLED_BYTES;
+    run->hist[ins]++;
+    run->bytes += off;
+}
+
+static void
+add_run(char *name, int event, int threshold, int variant)
+{
+    struct run *run;
+    int k;
+
+    if (num_runs >= MAX_RUNS)
+	errx(1, "too many events: %d", num_runs);
+
+    run = &run_list[num_runs++];
+    memset(run, 0, sizeof(*run));
+    run->name = name;
+    run->event = event;
+    run->threshold = threshold;
+    run->variant = variant;
+    run->seq = SEQ_BRANCH;
+    for (k = 0; trigger_table[k].prefix != NULL; k++) {
+	if (strncmp(name, trigger_table[k].prefix,
+		    strlen(trigger_table[k].prefix)) == 0) {
+	    run->seq = trigger_table[k].seq;
+	    run->has_trigger = 1;
+	    break;
+	}
+    }
+}
+
+/*
+ *  Add the events from the command line, and for native events
+ *  without a precise modifier, the precise variants that exist.
+ */
+static void
+make_run_list(void)
+{
+    char buf[500], *name;
+    int k, p, event;
+
+    for (k = 0; k < args.num_events; k++) {
+	add_run(args.name[k], args.event[k], args.threshold[k], 0);
+	if ((args.event[k] & PAPI_PRESET_MASK)
+	    || strstr(args.name[k], "precise") != NULL)
+	    continue;
+	for (p = 1; p <= MAX_PRECISE; p++) {
+	    snprintf(buf, sizeof(buf), "%s:precise=%d", args.name[k], p);
+	    if (PAPI_event_name_to_code(buf, &event) == PAPI_OK) {
+		name = strdup(buf);
+		add_run(name, event, args.threshold[k], 1);
+	    }
+	}
+    }
+}
+
+/*
+ *  Default events, the ones that have a trigger and exist here.
+ */
+static void
+default_events(void)
+{
+    static char *names[] = { "PAPI_BR_INS", "PAPI_LD_INS", "PAPI_FP_INS" };
+    int k, nev;
+
+    nev = 0;
+    for (k = 0; k < sizeof(names) / sizeof(names[0]); k++) {
+	if (PAPI_event_name_to_code(names[k], &args.event[nev]) == PAPI_OK
+	    && PAPI_query_event(args.event[nev]) == PAPI_OK) {
+	    args.name[nev] = names[k];
+	    args.threshold[nev] = args.overflow;
+	    nev++;
+	}
+    }
+    args.num_events = nev;
+    if (nev == 0) {
+	TOT_CYC_DEFAULT(args);
+    }
+}
+
+/*
+ *  Returns: 1 if the run was started, 0 if PAPI rejected the event.
+ */
+static int
+run_event(struct run *run, float secs)
+{
+    struct timeval start, now;
+    struct sequence *seq = &seq_list[run->seq];
+    int EventSet;
+
+    EventSet = PAPI_NULL;
+    if (PAPI_create_eventset(&EventSet) != PAPI_OK)
+	errx(1, "PAPI_create_eventset failed");
+    if (PAPI_add_event(EventSet, run->event) != PAPI_OK
+	|| PAPI_overflow(EventSet, run->event, run->threshold, 0,
+			 my_handler) != PAPI_OK) {
+	printf("%s: unable to overflow, skipped\n", run->name);
+	PAPI_cleanup_eventset(EventSet);
+	PAPI_destroy_eventset(&EventSet);
+	return 0;
+    }
+
+    cur_seq = seq;
+    cur_run = run;
+    gettimeofday(&start, NULL);
+    if (PAPI_start(EventSet) != PAPI_OK)
+	errx(1, "PAPI_start failed: %s", run->name);
+    do {
+	seq->run(SEQ_ITER);
+	gettimeofday(&now, NULL);
+    }
+    while (time_sub(now, start) < secs);
+    PAPI_stop(EventSet, NULL);
+    cur_run = NULL;
+
+    PAPI_cleanup_eventset(EventSet);
+    PAPI_destroy_eventset(&EventSet);
+    return 1;
+}
+
+/*
+ *  Returns: the smallest skid (ins) with at least frac of the samples
+ *  in the sequence at or below it.
+ */
+static int
+skid_percentile(struct run *run, float frac)
+{
+    long in_seq, sum;
+    int k;
+
+    in_seq = run->samples - run->outside;
+    sum = 0;
+    for (k = 0; k <= SLED_INS; k++) {
+	sum += run->hist[k];
+	if (sum >= frac * in_seq)
+	    return k;
+    }
+    return SLED_INS;
+}
+
+static void
+print_run(struct run *run)
+{
+    long in_seq, rest;
+    float mean;
+    int k;
+
+    in_seq = run->samples - run->outside;
+    printf("\n%s (%s sequence%s), threshold: %d\n", run->name,
+	   seq_list[run->seq].name, run->has_trigger ? "" : ", no trigger",
+	   run->threshold);
+    printf("samples: %ld, in sequence: %ld (%.1f%%)\n", run->samples,
+	   in_seq, 100.0 * in_seq / (float) MAX(run->samples, 1));
+    if (in_seq == 0)
+	return;
+
+    mean = 0.0;
+    for (k = 0; k <= SLED_INS; k++)
+	mean += k * run->hist[k];
+    mean /= (float) in_seq;
+    printf("skid (ins): mean: %.2f, median: %d, 90%%: %d, "
+	   "mean bytes: %.1f\n", mean, skid_percentile(run, 0.5),
+	   skid_percentile(run, 0.9), run->bytes / (float) in_seq);
+
+    rest = in_seq;
+    for (k = 0; k <= MAX_HIST_INS; k++) {
+	printf("  %d: %5.1f%%", k, 100.0 * run->hist[k] / (float) in_seq);
+	rest -= run->hist[k];
+	if (k % 5 == 4)
+	    printf("\n");
+    }
+    printf("  >%d: %5.1f%%\n", MAX_HIST_INS, 100.0 * rest / (float) in_seq);
+}
+
+int
+main(int argc, char **argv)
+{
+    float run_time;
+    int k, opt, num_errs;
+
+    set_default_args(&args);
+    args.prog_time = DEFAULT_TIME;
+    args.overflow = DEFAULT_OVERFLOW;
+    opt = parse_args(&args, argc, argv);
+    get_papi_events(&args, opt, argc, argv);
+    if (args.num_events == 0) {
+	default_events();
+    }
+
+    init_sequence(SEQ_BRANCH, "branch", run_branch, &skid_branch_start,
+		  &skid_branch_sled, &skid_branch_end);
+    init_sequence(SEQ_LOAD, "load", run_load, &skid_load_start,
+		  &skid_load_sled, &skid_load_end);
+    init_sequence(SEQ_FP, "fp", run_fp, &skid_fp_start,
+		  &skid_fp_sled, &skid_fp_end);
+
+    make_run_list();
+    run_time = MAX(args.prog_time / (float) num_runs, MIN_RUN_TIME);
+
+    printf("PC skid test, time: %d, blocks: %d x (trigger + %d ins)\n",
+	   args.prog_time, SKID_BLOCKS, SLED_INS);
+    print_event_list(&args);
+
+    num_errs = 0;
+    for (k = 0; k < num_runs; k++) {
+	if (! run_event(&run_list[k], run_time)) {
+	    /* Not every precise level exists on every cpu. */
+	    if (! run_list[k].variant)
+		num_errs++;
+	    continue;
+	}
+	print_run(&run_list[k]);
+	if (run_list[k].samples < MIN_SAMPLES
+	    || run_list[k].samples - run_list[k].outside
+	       < MIN_IN_SEQ * run_list[k].samples) {
+	    warnx("%s: too few samples in the sequence", run_list[k].name);
+	    num_errs++;
+	}
+    }
+    printf("\n");
+
+    EXIT_PASS_FAIL(num_errs == 0);
+}
+
+#else  /* ! __x86_64__ */
+
+int
+main(int argc, char **argv)
+{
+    printf("PC skid test is x86-64 only\n");
+    EXIT_PASS_FAIL(0);
+}
+
+#endif
@@ -0,0 +1,137 @@
+/*
+ *  STREAM style memory bandwidth kernels: copy, scale, add and triad.
+ *
+ *  The memory kernel is a latency bound random walk and never comes
+ *  close to saturating the memory bus.  These kernels stream through
+ *  three per-thread arrays of doubles (the -m size split three ways),
+ *  so running them on all threads saturates the memory bandwidth.
+ *
+ *    stream-copy   c = a            16 bytes per element
+ *    stream-scale  c = q * a        16 bytes per element
+ *    stream-add    c = a + b        24 bytes per element
+ *    stream-triad  c = a + q * b    24 bytes per element
+ *
+ *  As in STREAM, the byte counts don't include the write-allocate
+ *  reads of c.  All four only read a and b and write c, so they can
+ *  be mixed in any order and each can check its own result.  The
+ *  'stream' kernel name is short for all four.
+ *
+ *  Copyright (c) 2009-2013, Rice University.
+ *  See the file LICENSE for details.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "papi-tests.h"
+
+#define STREAM_SCALE   200000
+#define STREAM_Q       3.0
+#define STREAM_A       1.0
+#define STREAM_B       2.0
+
+/*
+ *  The four kernels share the arrays, so only the first one to get
+ *  here allocates them.  Each thread fills its own arrays, so the
+ *  pages are local to its node.
+ */
+static void
+stream_thread_init(struct prog_args *args, struct memory_state *mstate)
+{
+    long k, bytes;
+
+    if (mstate->stream_a != NULL)
+	return;
+    if (args->memsize == 0) {
+	errx(1, "the stream kernels require memsize (-m) > 0");
+    }
+
+    bytes = 1024L * 1024L * args->memsize / 3;
+    mstate->stream_size = bytes / sizeof(double);
+    mstate->stream_pos = 0;
+    if (posix_memalign((void **) &mstate->stream_a, 4096, bytes) != 0
+	|| posix_memalign((void **) &mstate->stream_b, 4096, bytes) != 0
+	|| posix_memalign((void **) &mstate->stream_c, 4096, bytes) != 0) {
+	errx(1, "%s: unable to allocate 3 x %ld bytes", __func__, bytes);
+    }
+
+    for (k = 0; k < mstate->stream_size; k++) {
+	mstate->stream_a[k] = STREAM_A;
+	mstate->stream_b[k] = STREAM_B;
+	mstate->stream_c[k] = 0.0;
+    }
+}
+
+static void
+stream_thread_fini(struct memory_state *mstate)
+{
+    free(mstate->stream_a);
+    free(mstate->stream_b);
+    free(mstate->stream_c);
+    mstate->stream_a = NULL;
+    mstate->stream_b = NULL;
+    mstate->stream_c = NULL;
+}
+
+/*
+ *  Generate the run function and struct for one kernel.  Each unit is
+ *  scale elements, picking up where the last unit left off and
+ *  wrapping around the arrays.  Check the last element written.
+ */
+#define STREAM_KERNEL(NAME, STR, EXPR, VALUE, BYTES, DESC)		\
+struct work_kernel NAME##_kernel;					\
+									\
+static int								\
+NAME##_run(struct memory_state *mstate, int work)			\
+{									\
+    double * restrict a = mstate->stream_a;				\
+    double * restrict b = mstate->stream_b;				\
+    double * restrict c = mstate->stream_c;				\
+    double q = STREAM_Q;						\
+    long size = mstate->stream_size;					\
+    long pos = mstate->stream_pos;					\
+    long n, k, end;							\
+    int num_errs = 0;							\
+									\
+    if (a == NULL)							\
+	return 1;							\
+									\
+    for (; work > 0; work--) {						\
+	for (n = 0; n < NAME##_kernel.scale; n += end - pos, pos = end) { \
+	    if (pos >= size)						\
+		pos = 0;						\
+	    end = MIN(size, pos + NAME##_kernel.scale - n);		\
+	    for (k = pos; k < end; k++) {				\
+		c[k] = EXPR;						\
+	    }								\
+	}								\
+	if (c[pos - 1] != (VALUE)) {					\
+	    warnx("%s: value is out of range: %g", STR, c[pos - 1]);	\
+	    num_errs++;							\
+	}								\
+    }									\
+    mstate->stream_pos = pos;						\
+    (void) b; (void) q;							\
+									\
+    return (num_errs);							\
+}									\
+									\
+struct work_kernel NAME##_kernel = {					\
+    STR, DESC, "PAPI_L3_TCM PAPI_PRF_DM PAPI_RES_STL",			\
+    NULL, stream_thread_init, stream_thread_fini, NAME##_run,		\
+    STREAM_SCALE, 0, 0, 0, 0, BYTES,					\
+};
+
+STREAM_KERNEL(stream_copy, "stream-copy", a[k],
+	      STREAM_A, 16, "STREAM copy c = a over the -m arrays")
+
+STREAM_KERNEL(stream_scale, "stream-scale", q * a[k],
+	      STREAM_Q * STREAM_A, 16, "STREAM scale c = q * a")
+
+STREAM_KERNEL(stream_add, "stream-add", a[k] + b[k],
+	      STREAM_A + STREAM_B, 24, "STREAM add c = a + b")
+
+STREAM_KERNEL(stream_triad, "stream-triad", a[k] + q * b[k],
+	      STREAM_A + STREAM_Q * STREAM_B, 24,
+	      "STREAM triad c = a + q * b")
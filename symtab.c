@@ -0,0 +1,314 @@
+/*
+ *  Attribute sample PCs to functions from the ELF symbol tables.
+ *
+ *  symtab_load() reads the function symbols from the executable and
+ *  every shared library loaded in the process (from dl_iterate_phdr(),
+ *  which gives the same files and load addresses as /proc/self/maps),
+ *  relocates them by the load bias and sorts them into one address
+ *  index.  After that, symtab_lookup() is a binary search over the
+ *  index and symtab_count() adds one to the function's sample count,
+ *  neither of which allocates or takes a lock, so both are safe to
+ *  call from an overflow handler.
+ *
+ *  PCs that are not inside any function (eg, the icache kernel's
+ *  generated code, or a stripped library) count as unknown.
+ *
+ *  Copyright (c) 2009-2013, Rice University.
+ *  See the file LICENSE for details.
+ */
+
+#define _GNU_SOURCE
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <elf.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <link.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "papi-tests.h"
+
+struct symbol {
+    unsigned long start;
+    unsigned long end;
+    char *name;
+    char *obj;
+    volatile long count;
+};
+
+static struct symbol *symtab = NULL;
+static long num_syms = 0;
+static long max_syms = 0;
+static int num_objs = 0;
+static volatile long unknown_count = 0;
+
+static void
+add_symbol(unsigned long start, unsigned long size, char *name, char *obj)
+{
+    if (num_syms >= max_syms) {
+	max_syms = (max_syms > 0) ? 2 * max_syms : 4096;
+	symtab = realloc(symtab, max_syms * sizeof(struct symbol));
+	if (symtab == NULL)
+	    errx(1, "%s: out of memory", __func__);
+    }
+    symtab[num_syms].start = start;
+    symtab[num_syms].end = start + size;
+    symtab[num_syms].name = strdup(name);
+    symtab[num_syms].obj = obj;
+    symtab[num_syms].count = 0;
+    num_syms++;
+}
+
+/*
+ *  Add the function symbols from one ELF file at load bias.  Use
+ *  .symtab if present (it has the static functions), else .dynsym.
+ */
+static void
+load_file(char *path, unsigned long bias)
+{
+    ElfW(Ehdr) *ehdr;
+    ElfW(Shdr) *shdr, *sec;
+    ElfW(Sym) *sym;
+    struct stat st;
+    char *base, *strtab, *obj;
+    long k, n, num;
+    int fd, type;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+	return;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(ElfW(Ehdr))) {
+	close(fd);
+	return;
+    }
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+	return;
+
+    ehdr = (ElfW(Ehdr) *) base;
+    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0
+	|| ehdr->e_shoff == 0 || ehdr->e_shentsize != sizeof(ElfW(Shdr))) {
+	munmap(base, st.st_size);
+	return;
+    }
+    shdr = (ElfW(Shdr) *) (base + ehdr->e_shoff);
+
+    type = SHT_DYNSYM;
+    for (k = 0; k < ehdr->e_shnum; k++) {
+	if (shdr[k].sh_type == SHT_SYMTAB)
+	    type = SHT_SYMTAB;
+    }
+
+    obj = strrchr(path, '/');
+    obj = strdup((obj != NULL) ? obj + 1 : path);
+    num_objs++;
+
+    for (k = 0; k < ehdr->e_shnum; k++) {
+	sec = &shdr[k];
+	if (sec->sh_type != type || sec->sh_link >= ehdr->e_shnum)
+	    continue;
+	sym = (ElfW(Sym) *) (base + sec->sh_offset);
+	strtab = base + shdr[sec->sh_link].sh_offset;
+	num = sec->sh_size / sizeof(ElfW(Sym));
+	for (n = 0; n < num; n++) {
+	    if ((ELF64_ST_TYPE(sym[n].st_info) == STT_FUNC
+		 || ELF64_ST_TYPE(sym[n].st_info) == STT_GNU_IFUNC)
+		&& sym[n].st_shndx != SHN_UNDEF && sym[n].st_value != 0) {
+		add_symbol(bias + sym[n].st_value, sym[n].st_size,
+			   strtab + sym[n].st_name, obj);
+	    }
+	}
+    }
+    munmap(base, st.st_size);
+}
+
+static int
+load_object(struct dl_phdr_info *info, size_t size, void *data)
+{
+    char *path = (char *) info->dlpi_name;
+
+    /* The main program has an empty name, the vdso has no file. */
+    if (path == NULL || path[0] == 0) {
+	if (num_objs > 0)
+	    return 0;
+	path = "/proc/self/exe";
+    }
+    if (path[0] != '/')
+	return 0;
+
+    load_file(path, info->dlpi_addr);
+    return 0;
+}
+
+static int
+cmp_symbol(const void *a, const void *b)
+{
+    const struct symbol *x = a, *y = b;
+
+    if (x->start != y->start)
+	return (x->start < y->start) ? -1 : 1;
+    /* For aliases, put the one with the larger size first. */
+    if (x->end - x->start != y->end - y->start)
+	return (x->end - x->start > y->end - y->start) ? -1 : 1;
+    return 0;
+}
+
+/*
+ *  Load and sort the symbols, drop the aliases, and extend the
+ *  symbols with no size to the next symbol in the same object (not
+ *  across the gap to the next object).  Call before PAPI_start().
+ */
+void
+symtab_load(void)
+{
+    long k, n;
+
+    num_syms = 0;
+    num_objs = 0;
+    dl_iterate_phdr(load_object, NULL);
+    if (num_syms == 0) {
+	warnx("%s: no function symbols found", __func__);
+	return;
+    }
+
+    qsort(symtab, num_syms, sizeof(struct symbol), cmp_symbol);
+    n = 0;
+    for (k = 0; k < num_syms; k++) {
+	if (n > 0 && symtab[k].start == symtab[n - 1].start)
+	    continue;
+	symtab[n++] = symtab[k];
+    }
+    num_syms = n;
+    for (k = 0; k < num_syms; k++) {
+	if (symtab[k].end != symtab[k].start)
+	    continue;
+	if (k + 1 < num_syms && symtab[k + 1].obj == symtab[k].obj)
+	    symtab[k].end = symtab[k + 1].start;
+	else
+	    symtab[k].end = symtab[k].start + 1;
+    }
+
+    printf("symbols: %ld functions from %d objects\n", num_syms, num_objs);
+}
+
+/*
+ *  Returns: the index of the function containing pc, or -1 if none.
+ *  Async signal safe.
+ */
+long
+symtab_lookup(void *pc)
+{
+    unsigned long addr = (unsigned long) pc;
+    long lo, hi, mid;
+
+    if (num_syms == 0 || addr < symtab[0].start)
+	return -1;
+
+    /* Find the last symbol with start <= addr. */
+    lo = 0;
+    hi = num_syms - 1;
+    while (lo < hi) {
+	mid = (lo + hi + 1) / 2;
+	if (symtab[mid].start <= addr)
+	    lo = mid;
+	else
+	    hi = mid - 1;
+    }
+    return (addr < symtab[lo].end) ? lo : -1;
+}
+
+/*
+ *  Add one sample for pc, async signal safe.
+ */
+void
+symtab_count(void *pc)
+{
+    long k = symtab_lookup(pc);
+
+    if (k >= 0)
+	__sync_fetch_and_add(&symtab[k].count, 1);
+    else
+	__sync_fetch_and_add(&unknown_count, 1);
+}
+
+char *
+symtab_name(long k)
+{
+    return (k >= 0 && k < num_syms) ? symtab[k].name : "unknown";
+}
+
+long
+symtab_samples(long k)
+{
+    return (k >= 0 && k < num_syms) ? symtab[k].count : unknown_count;
+}
+
+/*
+ *  Returns: the total samples, including unknown.
+ */
+long
+symtab_total(void)
+{
+    long k, total;
+
+    total = unknown_count;
+    for (k = 0; k < num_syms; k++)
+	total += symtab[k].count;
+    return total;
+}
+
+void
+symtab_reset(void)
+{
+    long k;
+
+    for (k = 0; k < num_syms; k++)
+	symtab[k].count = 0;
+    unknown_count = 0;
+}
+
+static int
+cmp_count(const void *a, const void *b)
+{
+    long x = symtab[*(const long *) a].count;
+    long y = symtab[*(const long *) b].count;
+
+    return (x < y) ? 1 : (x > y) ? -1 : 0;
+}
+
+/*
+ *  Print the top num functions by samples, a flat profile.
+ */
+void
+symtab_print_profile(int num)
+{
+    long *order, total, k, n;
+
+    total = unknown_count;
+    n = 0;
+    order = malloc(MAX(num_syms, 1) * sizeof(long));
+    for (k = 0; k < num_syms; k++) {
+	if (symtab[k].count > 0) {
+	    total += symtab[k].count;
+	    order[n++] = k;
+	}
+    }
+    qsort(order, n, sizeof(long), cmp_count);
+
+    printf("%10s  %6s  %s\n", "samples", "pct", "function (object)");
+    for (k = 0; k < n && k < num; k++) {
+	printf("%10ld  %6.2f  %s (%s)\n", symtab[order[k]].count,
+	       100.0 * symtab[order[k]].count / (float) MAX(total, 1),
+	       symtab[order[k]].name, symtab[order[k]].obj);
+    }
+    if (unknown_count > 0) {
+	printf("%10ld  %6.2f  unknown\n", unknown_count,
+	       100.0 * unknown_count / (float) MAX(total, 1));
+    }
+    free(order);
+}
@@ -10,6 +10,19 @@
  *  compared to the rate with no interrupts.  In the threaded case, we
  *  count the total work summed over all threads.
  *
+ *  Thread zero moves all threads from one phase (init, run, stop) to
+ *  the next with a blocking barrier, so threads that are waiting sleep
+ *  instead of spinning and taking the CPU from the threads that are
+ *  still working.  The test reports the wake latency of the phase
+ *  transitions.
+ *
+ *  With -T, the test also steps the number of threads (eg, 1, 2, 4, ...
+ *  up to the core count) and runs the threshold sweep for each count
+ *  in the same process.  The threads are created once for the largest
+ *  count, and the threads beyond the current count sleep in the
+ *  barrier.  The summary is a matrix of overhead and interrupts per
+ *  second per thread, one column per thread count.
+ *
  *  Copyright (c) 2009-2013, Rice University.
  *  See the file LICENSE for details.
  *
@@ -50,13 +63,21 @@ static float Work[SIZE];
 static float Intr[SIZE];
 static float Overhead[SIZE];
 
+static int   Points[MAX_SWEEP];
+static float SweepOver[MAX_SWEEP][SIZE];
+static float SweepIntr[MAX_SWEEP][SIZE];
+static int   sweep_index[MAX_SWEEP];
+static int   num_points;
+static int   num_active;
+
 static struct prog_args args;
 static pthread_key_t key;
 
 static int EventSet[MAX_THREADS];
+static struct memory_state memstate[MAX_THREADS];
 
-volatile int state[MAX_THREADS];
-volatile int ready[MAX_THREADS];
+static struct barrier phase_barrier;
+static volatile int phase = INIT;
 
 static long work[MAX_THREADS];
 static long cur_work[MAX_THREADS];
@@ -87,40 +108,13 @@ my_handler(int EventSet, void *pc, long long ovec, void *context)
 {
     int tid = *(int *)pthread_getspecific(key);
 
-    if (tid < 0 || tid >= args.num_threads) {
+    if (tid < 0 || tid >= num_active) {
 	warnx("thread id from getspecific out of bounds: %d", tid);
 	return;
     }
     count[tid]++;
 }
 
-void
-set_state(int st)
-{
-    int k;
-
-    for (k = 0; k < args.num_threads; k++) {
-	ready[k] = NONE;
-	state[k] = st;
-    }
-}
-
-void
-wait_on_state(int st)
-{
-    int k, num_ready;
-
-    do {
-	num_ready = 1;
-	for (k = 1; k < args.num_threads; k++) {
-	    if (ready[k] == st) {
-		num_ready++;
-	    }
-	}
-    }
-    while (num_ready < args.num_threads);
-}
-
 void
 print_stats(struct timeval now, struct timeval last)
 {
@@ -128,7 +122,7 @@ print_stats(struct timeval now, struct timeval last)
     long min_count, max_count, total_count;
     int k;
 
-    for (k = 0; k < args.num_threads; k++) {
+    for (k = 0; k < num_active; k++) {
 	cur_work[k] = work[k];
 	cur_count[k] = count[k];
     }
@@ -140,7 +134,7 @@ print_stats(struct timeval now, struct timeval last)
     max_count = 0;
     total_count = 0;
 
-    for (k = 0; k < args.num_threads; k++) {
+    for (k = 0; k < num_active; k++) {
 	diff = cur_work[k] - prev_work[k];
 	min_work = MIN(min_work, diff);
 	max_work = MAX(max_work, diff);
@@ -158,7 +152,7 @@ print_stats(struct timeval now, struct timeval last)
 	   min_count, max_count, total_count,
 	   ((float) (args.threshold[0] * total_count))/((float) total_work));
 
-    for (k = 0; k < args.num_threads; k++) {
+    for (k = 0; k < num_active; k++) {
 	prev_count[k] = cur_count[k];
 	prev_work[k] = cur_work[k];
     }
@@ -188,9 +182,10 @@ run_with_interrupts(int tid)
 
     last = time_start;
     done_begin = 0;
-    while (state[tid] == RUN) {
-	run_flops(1);
-	work[tid] += 1;
+    while (phase == RUN) {
+	run_kernels(&args, &memstate[tid], 1);
+	work[tid] += kernel_work(&args, 1);
+	topology_check_cpu(tid);
 
 	/*
 	 * Thread zero watches time of day, prints incremental results
@@ -205,7 +200,7 @@ run_with_interrupts(int tid)
 	    if (!done_begin && time_sub(now, time_start) >= len_begin) {
 		begin_work = 0;
 		begin_count = 0;
-		for (k = 0; k < args.num_threads; k++) {
+		for (k = 0; k < num_active; k++) {
 		    begin_work += work[k];
 		    begin_count += count[k];
 		}
@@ -215,11 +210,12 @@ run_with_interrupts(int tid)
 	    else if (done_begin && time_sub(now, time_begin) >= len_end) {
 		end_work = 0;
 		end_count = 0;
-		for (k = 0; k < args.num_threads; k++) {
+		for (k = 0; k < num_active; k++) {
 		    end_work += work[k];
 		    end_count += count[k];
 		}
 		time_end = now;
+		phase = STOP;
 		break;
 	    }
 	}
@@ -232,27 +228,27 @@ run_with_interrupts(int tid)
     }
 }
 
+/*
+ *  Run the threshold sweep with the first num_active threads.
+ */
 void
-thread_zero(void *data)
+run_sweep(void)
 {
     long this_work, this_count;
     float evrate, delta_time;
     int k, num;
 
-    if (pthread_setspecific(key, data) != 0) {
-	errx(1, "pthread_setspecific failed");
-    }
-    EventSet[0] = event_set_for_overflow(&args, &my_handler);
-
-    /* Wait for side threads to finish INIT. */
-    wait_on_state(INIT);
+    fnum_threads = (float) num_active;
+    base_work = -1;
+    base_evrate = -1.0;
 
     max_index = 0;
     for (num = 0; Threshold[num] >= 0; num++) {
 	args.threshold[0] = Threshold[num];
-	printf("\n%s@%d\n", args.name[0], args.threshold[0]);
+	printf("\n%s@%d, threads: %d\n", args.name[0], args.threshold[0],
+	       num_active);
 
-	for (k = 0; k < args.num_threads; k++) {
+	for (k = 0; k < num_active; k++) {
 	    work[k] = 0;
 	    cur_work[k] = 0;
 	    prev_work[k] = 0;
@@ -266,12 +262,11 @@ thread_zero(void *data)
 	end_count = 0;
 
 	/* launch threads */
-	set_state(RUN);
-	wait_on_state(RUN);
+	phase = RUN;
+	barrier_wait(&phase_barrier);
 	gettimeofday(&time_start, NULL);
 	run_with_interrupts(0);
-	set_state(STOP);
-	wait_on_state(STOP);
+	barrier_wait(&phase_barrier);
 
 	this_work = end_work - begin_work;
 	this_count = end_count - begin_count;
@@ -296,8 +291,39 @@ thread_zero(void *data)
 	    break;
 	}
     }
+}
+
+void
+thread_zero(void *data)
+{
+    int k, p;
+
+    if (pthread_setspecific(key, data) != 0) {
+	errx(1, "pthread_setspecific failed");
+    }
+    topology_pin(0);
+    EventSet[0] = event_set_for_overflow(&args, &my_handler);
+    init_thread_kernels(&args, &memstate[0]);
+
+    /* Wait for side threads to finish INIT. */
+    barrier_wait(&phase_barrier);
+
+    for (p = 0; p < num_points; p++) {
+	num_active = Points[p];
+	if (num_points > 1) {
+	    printf("\n========== threads: %d ==========\n", num_active);
+	}
+	run_sweep();
+
+	for (k = 0; k <= max_index; k++) {
+	    SweepOver[p][k] = Overhead[k];
+	    SweepIntr[p][k] = Intr[k]/fnum_threads;
+	}
+	sweep_index[p] = max_index;
+    }
 
-    set_state(EXIT);
+    phase = EXIT;
+    barrier_wait(&phase_barrier);
 }
 
 void *
@@ -308,24 +334,57 @@ side_thread(void *data)
     if (pthread_setspecific(key, data) != 0) {
 	errx(1, "pthread_setspecific failed");
     }
+    topology_pin(tid);
     EventSet[tid] = event_set_for_overflow(&args, &my_handler);
-    ready[tid] = INIT;
+    memstate[tid].tid = tid;
+    init_thread_kernels(&args, &memstate[tid]);
+    barrier_wait(&phase_barrier);
 
+    /* Sleep in the barrier until thread zero starts a run or exits. */
     for (;;) {
-	if (state[tid] == EXIT) {
+	barrier_wait(&phase_barrier);
+	if (phase == EXIT) {
 	    break;
 	}
-	else if (state[tid] == RUN) {
-	    ready[tid] = RUN;
+	if (tid < num_active) {
 	    run_with_interrupts(tid);
-	    ready[tid] = STOP;
 	}
-	// usleep(500);
+	barrier_wait(&phase_barrier);
     }
 
     return NULL;
 }
 
+/*
+ *  One row per threshold, one column per thread count.  A dash means
+ *  the sweep for that count stopped at MAX_OVER_RATE before this row.
+ */
+void
+print_matrix(char *title, float matrix[MAX_SWEEP][SIZE])
+{
+    int k, p, max;
+
+    printf("%s\n%15s", title, args.name[0]);
+    max = 0;
+    for (p = 0; p < num_points; p++) {
+	printf("  %8d", Points[p]);
+	max = MAX(max, sweep_index[p]);
+    }
+    printf("\n");
+
+    for (k = 0; k <= max; k++) {
+	printf("%15ld", Threshold[k]);
+	for (p = 0; p < num_points; p++) {
+	    if (k <= sweep_index[p])
+		printf("  %8.1f", matrix[p][k]);
+	    else
+		printf("  %8s", "-");
+	}
+	printf("\n");
+    }
+    printf("\n");
+}
+
 int
 main(int argc, char **argv)
 {
@@ -340,16 +399,39 @@ main(int argc, char **argv)
     if (args.num_events == 0) {
 	TOT_CYC_DEFAULT(args);
     }
+    set_default_kernels(&args, 0);
     args.prog_time = MAX(args.prog_time, MIN_TIME);
     args.num_events = 1;
 
+    /* Without -T, one point at -p threads, else -p is the largest count. */
+    num_points = 0;
+    if (args.num_sweep == 0) {
+	Points[num_points++] = args.num_threads;
+    }
+    else {
+	args.num_threads = 0;
+	for (k = 0; k < args.num_sweep; k++) {
+	    Points[num_points++] = args.sweep[k];
+	    args.num_threads = MAX(args.num_threads, args.sweep[k]);
+	}
+    }
+
     printf("Threads Overhead Test, threads: %d\n", args.num_threads);
+    if (num_points > 1) {
+	printf("thread counts:");
+	for (k = 0; k < num_points; k++) {
+	    printf(" %d", Points[k]);
+	}
+	printf("\n");
+    }
+    print_kernel_list(&args);
+    init_kernels(&args);
+    topology_init(&args);
 
     len_begin = 0.25 * (float) args.prog_time;
     len_end = 0.75 * (float) args.prog_time;
-    fnum_threads = (float) args.num_threads;
 
-    set_state(INIT);
+    barrier_init(&phase_barrier, args.num_threads);
 
     for (k = 0; k < MAX_THREADS; k++) {
 	tid[k] = k;
@@ -367,20 +449,32 @@ main(int argc, char **argv)
 	if (pthread_create(&td[k], NULL, side_thread, &tid[k]) != 0)
 	    errx(1, "pthread create failed");
     }
-    thread_zero(&td[0]);
+    thread_zero(&tid[0]);
 
     for (k = 1; k < args.num_threads; k++) {
 	pthread_join(td[k], NULL);
     }
 
     printf("\nThreads Overhead Test, threads: %d\n\n", args.num_threads);
-    printf("%15s  %10s  %10s  %10s  %12s\n",
-	   args.name[0], "Work/sec", "Intr/thr", "Intr/sec", "Overhead %");
+    if (num_points == 1) {
+	printf("%15s  %10s  %10s  %10s  %12s\n",
+	       args.name[0], "Work/sec", "Intr/thr", "Intr/sec", "Overhead %");
 
-    for (k = 0; k <= max_index; k++) {
-	printf("%15ld  %10.1f  %10.1f  %10.1f  %10.1f\n",
-	       Threshold[k], Work[k], Intr[k]/fnum_threads, Intr[k], Overhead[k]);
+	for (k = 0; k <= max_index; k++) {
+	    printf("%15ld  %10.1f  %10.1f  %10.1f  %10.1f\n",
+		   Threshold[k], Work[k], Intr[k]/fnum_threads, Intr[k], Overhead[k]);
+	}
+    }
+    else {
+	print_matrix("Overhead %", SweepOver);
+	print_matrix("Intr/sec/thread", SweepIntr);
+    }
+    printf("\n");
+    for (k = 0; k < args.num_threads; k++) {
+	printf("tid: %d, cpu: %d, moves: %ld\n", k,
+	       topology_last_cpu(k), topology_moves(k));
     }
+    barrier_print(&phase_barrier, "phase");
     printf("\n");
 
     return 0;
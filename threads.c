@@ -34,8 +34,14 @@ static int EventSet[MAX_THREADS];
 static struct memory_state memstate[MAX_THREADS];
 static struct min_max_report rep[MAX_THREADS];
 
+static double Bytes[MAX_THREADS];
+static float Secs[MAX_THREADS];
+static long TotCount[MAX_THREADS];
+static long TotWork[MAX_THREADS];
+
+static struct barrier init_barrier;
+
 static volatile long count[MAX_THREADS];
-static volatile int ready[MAX_THREADS];
 static volatile int done = 0;
 
 void
@@ -48,6 +54,8 @@ my_handler(int EventSet, void *pc, long long ovec, void *context)
 	return;
     }
     count[tid]++;
+    if (args.ring_size > 0)
+	sampler_record(tid, pc, ovec);
 }
 
 /*
@@ -60,10 +68,15 @@ run_test(int tid)
 {
     struct timeval start, now, last;
     char *eol = (args.verbose) ? ", " : "\n";
+    char gbs[50], wstr[50];
+    double bytes;
     int work, num_errs;
     int my_start = 0;
 
     INIT_REPORT(rep[tid]);
+    Bytes[tid] = 0.0;
+    TotCount[tid] = 0;
+    TotWork[tid] = 0;
 
     gettimeofday(&start, NULL);
     last = start;
@@ -92,19 +105,27 @@ run_test(int tid)
 	count[tid] = 0;
 	work = 0;
 	do {
-	    num_errs += run_flops(5);
-	    work += 5;
-	    if (args.memsize > 0) {
-		num_errs += run_memory(&memstate[tid], 5);
-		work += 5;
-	    }
+	    num_errs += run_kernels(&args, &memstate[tid], 5);
+	    work += kernel_work(&args, 5);
 	}
 	while (work < args.work);
 
 	gettimeofday(&now, NULL);
+	topology_check_cpu(tid);
+	bytes = work_bytes(&args, work);
+	Bytes[tid] += bytes;
+	TotCount[tid] += count[tid];
+	TotWork[tid] += work;
+	gbs[0] = 0;
+	if (bytes > 0.0) {
+	    snprintf(gbs, sizeof(gbs), ", %.2f GB/s",
+		     bytes / (1.0e9 * time_sub(now, last)));
+	}
 	if (tid == 0 || !args.single) {
-	    printf("time: %.1f, tid: %d, work: %d, count: %ld%s",
-		   time_sub(now, start), tid, work, count[tid], eol);
+	    printf("time: %.1f, tid: %d, work: %s%s, count: %ld%s",
+		   time_sub(now, start), tid,
+		   work_str(&args, work, wstr, sizeof(wstr)),
+		   gbs, count[tid], eol);
 	    if (args.verbose) {
 		float fcount = (float) count[tid];
 		float fwork = (float) work;
@@ -122,37 +143,44 @@ run_test(int tid)
     while (time_sub(now, start) <= args.prog_time);
 
     PAPI_stop(EventSet[tid], NULL);
+    Secs[tid] = time_sub(now, start);
 
     /*
      * The memory accesses in one thread randomly distort the running
      * time of the other threads.  So, we need a looser criteria for
-     * success.
+     * success, unless the memory is bound to the thread's own node
+     * and the thread is pinned, so it can't move to another node.
      */
     rep[tid].avg = rep[tid].total / (float)rep[tid].num;
-    rep[tid].pass = (num_errs == 0) && (rep[tid].min > 0.35 * rep[tid].avg)
-	&& (rep[tid].max < 1.50 * rep[tid].avg);
+    if (args.numa_policy == NUMA_LOCAL && args.pin_policy != PIN_NONE) {
+	rep[tid].pass = (num_errs == 0) && (rep[tid].min > 0.75 * rep[tid].avg)
+	    && (rep[tid].max < 1.25 * rep[tid].avg);
+    } else {
+	rep[tid].pass = (num_errs == 0) && (rep[tid].min > 0.35 * rep[tid].avg)
+	    && (rep[tid].max < 1.50 * rep[tid].avg);
+    }
 }
 
 void *
 my_thread(void *data)
 {
     int tid = *(int *)data;
-    int k, num_ready;
 
     if (pthread_setspecific(key, data) != 0)
 	errx(1, "pthread_setspecific failed");
 
+    topology_pin(tid);
     EventSet[tid] = event_set_for_overflow(&args, &my_handler);
-    init_memory(&memstate[tid], args.memsize);
-
-    /* Wait for all threads to finish init_memory. */
-    ready[tid] = 1;
-    do {
-	num_ready = 0;
-	for (k = 0; k < args.num_threads; k++)
-	    num_ready += ready[k];
+    memstate[tid].tid = tid;
+    init_thread_kernels(&args, &memstate[tid]);
+    if (args.ring_size > 0)
+	sampler_thread_init(tid);
+    if (tid == 0 || !args.single) {
+	print_memory_info(&memstate[tid], tid);
     }
-    while (num_ready < args.num_threads);
+
+    /* Wait (blocked, not spinning) for all threads to finish init. */
+    barrier_wait(&init_barrier);
 
     run_test(tid);
     done = 1;
@@ -165,6 +193,7 @@ main(int argc, char **argv)
 {
     pthread_t td[MAX_THREADS];
     int tid[MAX_THREADS];
+    double total_gbs;
     int k, opt, pass;
 
     set_default_args(&args);
@@ -174,16 +203,24 @@ main(int argc, char **argv)
     if (args.num_events == 0) {
 	TOT_CYC_DEFAULT(args);
     }
+    set_default_kernels(&args, 1);
     args.prog_time = MAX(args.prog_time, 15);
 
     printf("Threads Stress test, time: %d, threads: %d\n",
 	   args.prog_time, args.num_threads);
     print_event_list(&args);
+    print_kernel_list(&args);
+    if (args.numa_policy != NUMA_NONE) {
+	printf("NUMA policy: %s, nodes: %d\n",
+	       numa_policy_name(args.numa_policy), numa_num_nodes());
+    }
+    init_kernels(&args);
+    topology_init(&args);
 
     for (k = 0; k < MAX_THREADS; k++) {
-	ready[k] = 0;
 	tid[k] = k;
     }
+    barrier_init(&init_barrier, args.num_threads);
 
     if (PAPI_thread_init(pthread_self) != PAPI_OK)
         errx(1, "PAPI_thread_init failed");
@@ -191,6 +228,9 @@ main(int argc, char **argv)
     if (pthread_key_create(&key, NULL) != 0)
         errx(1, "pthread key create failed");
 
+    if (args.ring_size > 0)
+	sampler_start(&args, args.num_threads);
+
     for (k = 1; k < args.num_threads; k++) {
 	if (pthread_create(&td[k], NULL, my_thread, &tid[k]) != 0)
 	    errx(1, "pthread create failed");
@@ -200,17 +240,30 @@ main(int argc, char **argv)
     for (k = 1; k < args.num_threads; k++) {
 	pthread_join(td[k], NULL);
     }
+    pass = 1;
+    if (args.ring_size > 0 && sampler_stop() > 0)
+	pass = 0;
 
     printf("\nThreads Stress test, time: %d, threads: %d\n",
 	   args.prog_time, args.num_threads);
     print_event_list(&args);
 
-    pass = 1;
+    total_gbs = 0.0;
     for (k = 0; k < args.num_threads; k++) {
-	printf("tid: %d, min: %ld, avg: %.1f, max: %ld\n",
-	       k, rep[k].min, rep[k].avg, rep[k].max);
+	printf("tid: %d, min: %ld, avg: %.1f, max: %ld, "
+	       "intr/sec: %.1f, work/sec: %.1f, cpu: %d, moves: %ld\n",
+	       k, rep[k].min, rep[k].avg, rep[k].max,
+	       TotCount[k] / MAX(Secs[k], 0.001),
+	       TotWork[k] / MAX(Secs[k], 0.001),
+	       topology_last_cpu(k), topology_moves(k));
 	pass = pass && rep[k].pass;
+	total_gbs += Bytes[k] / (1.0e9 * MAX(Secs[k], 0.001));
+    }
+    if (total_gbs > 0.0) {
+	printf("bandwidth: %.2f GB/s total, %.2f GB/s per thread\n",
+	       total_gbs, total_gbs / args.num_threads);
     }
+    barrier_print(&init_barrier, "init");
 
     EXIT_PASS_FAIL(pass);
 }
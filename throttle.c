@@ -11,6 +11,19 @@
  *  divided by work), compared to a moderate rate of interrupts
  *  (50-100/sec).  See the README file for more explanation.
  *
+ *  With -e, run the sweep once for each -k kernel separately and
+ *  print the overheads side by side, eg, scalar flops vs. AVX-512.
+ *
+ *  With -U, the handler also unwinds the call stack on each sample,
+ *  and with -D, the sweep runs once for each recursion depth of the
+ *  recurse kernel (the default kernel with -D), so the summary shows
+ *  overhead versus threshold versus stack depth.
+ *
+ *  If the kernels have a known count for the event (eg, the 'exact'
+ *  kernel and PAPI_TOT_INS), then we also compare interrupts times
+ *  threshold against the expected number of events for the work done
+ *  and report the exact fraction of lost samples.
+ *
  *  Copyright (c) 2009-2013, Rice University.
  *  See the file LICENSE for details.
  *
@@ -48,20 +61,32 @@ static float Work[SIZE];
 static float Intr[SIZE];
 static float Overhead[SIZE];
 static float Throttle[SIZE];
+static float Lost[SIZE];
 static int   Ok[SIZE];
 
+static float Frames[SIZE];
+
+static float EachOverhead[MAX_KERNELS][SIZE];
+static float EachThrottle[MAX_KERNELS][SIZE];
+static float DepthOverhead[MAX_DEPTHS][SIZE];
+static float DepthFrames[MAX_DEPTHS][SIZE];
+
 static struct prog_args args;
+static struct memory_state memstate;
 static int EventSet;
 
 static long base_work = -1;
 static float base_evrate = -1.0;
 
 static volatile long count = 0;
+static volatile long frames = 0;
 
 void
 my_handler(int EventSet, void *pc, long long ovec, void *context)
 {
     count++;
+    if (args.unwind_mode != UNWIND_NONE)
+	frames += unwind_stack(args.unwind_mode, args.unwind_max, context);
 }
 
 void
@@ -69,11 +94,13 @@ run_test(void)
 {
     struct timeval start, now;
     long work, min_work, max_work, total_work;
-    long min_intr, max_intr, total_intr;
-    int k, ok, tick, warmup;
-    float evrate;
+    long min_intr, max_intr, total_intr, total_frames;
+    int k, ok, tick, warmup, oracle;
+    float evrate, lost;
+    char wstr[50];
 
     warmup = MAX(args.prog_time/5, 5);
+    oracle = (expected_events(&args, args.name[0], 1) > 0.0);
 
     for (k = 0; Threshold[k] >= 0; k++) {
 	args.threshold[0] = Threshold[k];
@@ -87,6 +114,8 @@ run_test(void)
 	max_intr = 0;
 	total_work = 0;
 	total_intr = 0;
+	total_frames = 0;
+	frames = 0;
 	tick = 0;
 
 	gettimeofday(&start, NULL);
@@ -99,14 +128,22 @@ run_test(void)
 	}
 
 	while (tick < warmup + args.prog_time) {
-	    run_flops(10);
-	    work += 10;
+	    run_kernels(&args, &memstate, 10);
+	    work += kernel_work(&args, 10);
 	    gettimeofday(&now, NULL);
 	    if (time_sub(now, start) >= 1.0 + (float)tick) {
 		tick++;
 		evrate = (float)Threshold[k] * count / (float)work;
-		printf("time: %.1f, work: %ld, intr: %ld, evrate: %.4e\n",
-		       time_sub(now, start), work, count, evrate);
+		printf("time: %.1f, work: %s, intr: %ld, evrate: %.4e",
+		       time_sub(now, start),
+		       work_str(&args, work, wstr, sizeof(wstr)),
+		       count, evrate);
+		if (oracle && Threshold[k] > 0) {
+		    lost = 100.0 * (1.0 - (float)Threshold[k] * count
+			    / expected_events(&args, args.name[0], work));
+		    printf(", lost: %.2f%%", lost);
+		}
+		printf("\n");
 		if (tick > warmup) {
 		    min_work = MIN(min_work, work);
 		    max_work = MAX(max_work, work);
@@ -114,8 +151,10 @@ run_test(void)
 		    max_intr = MAX(max_intr, count);
 		    total_work += work;
 		    total_intr += count;
+		    total_frames += frames;
 		}
 		count = 0;
+		frames = 0;
 		work = 0;
 	    }
 	}
@@ -138,27 +177,50 @@ run_test(void)
 	Overhead[k] = 100.0 * (1.0 - total_work / (float)base_work);
 	Throttle[k] = (base_evrate < 0.0) ? 0.0
 	     : 100.0 * (1.0 - evrate / (float)base_evrate);
+	Lost[k] = (!oracle || Threshold[k] == 0) ? 0.0
+	     : 100.0 * (1.0 - (float)Threshold[k] * total_intr
+			/ expected_events(&args, args.name[0], total_work));
+	Frames[k] = total_frames / (float)MAX(total_intr, 1);
 	Ok[k] = (max_work <= min_work + 35 || (float)max_work <= 1.1 * min_work)
 	     && (max_intr <= min_intr + 20 || (float)max_intr <= 1.1 * min_intr);
 
 	printf("Avgerage work: %.1f, intr: %.1f, evrate: %.4e\n",
 	       Work[k], Intr[k], evrate);
-	printf("Overhead: %.1f%%, Throttle: %.1f%%%s\n",
-	       Overhead[k], Throttle[k],
-	       Ok[k] ? "" : "  (may be inaccurate)");
+	printf("Overhead: %.1f%%, Throttle: %.1f%%",
+	       Overhead[k], Throttle[k]);
+	if (oracle) {
+	    printf(", Lost: %.2f%%", Lost[k]);
+	}
+	if (args.unwind_mode != UNWIND_NONE) {
+	    printf(", Frames: %.1f", Frames[k]);
+	}
+	printf("%s\n", Ok[k] ? "" : "  (may be inaccurate)");
     }
 
     printf("\nOverhead and Throttle test\n");
-    printf("\n%15s  %10s  %11s  %12s  %12s\n",
-	   args.name[0], "Work/sec", "Intr/sec", "Overhead %", "Throttle %");
+    printf("\n%15s  %10s  %11s  %12s  %12s%s%s\n",
+	   args.name[0], "Work/sec", "Intr/sec", "Overhead %", "Throttle %",
+	   oracle ? "      Lost %" : "",
+	   (args.unwind_mode != UNWIND_NONE) ? "    Frames" : "");
 
     ok = 1;
     for (k = 0; Threshold[k] >= 0; k++) {
-	printf("%15ld  %10.1f  %11.1f  %10.1f  %12.1f%s\n",
-	       Threshold[k], Work[k], Intr[k], Overhead[k], Throttle[k],
-	       Ok[k] ? "" : "  *");
+	printf("%15ld  %10.1f  %11.1f  %10.1f  %12.1f",
+	       Threshold[k], Work[k], Intr[k], Overhead[k], Throttle[k]);
+	if (oracle) {
+	    printf("  %10.2f", Lost[k]);
+	}
+	if (args.unwind_mode != UNWIND_NONE) {
+	    printf("  %8.1f", Frames[k]);
+	}
+	printf("%s\n", Ok[k] ? "" : "  *");
 	ok = ok && Ok[k];
     }
+    if (oracle) {
+	printf("\nLost = 1 - (intr)(threshold)/(expected events), where the\n"
+	       "expected events are exact for the -k kernels.  Negative values\n"
+	       "mean the handler's own events were counted.\n");
+    }
     if (! ok) {
 	printf("\n* = the process did not get a steady rate of interrupts and the\n"
 	       "    results may be inaccurate, probably due to system load.\n");
@@ -166,6 +228,101 @@ run_test(void)
     printf("\n");
 }
 
+/*
+ *  Run the sweep once per kernel and summarize the overhead and
+ *  throttle for each kernel side by side.
+ */
+void
+run_each_kernel(void)
+{
+    struct work_kernel *kernel[MAX_KERNELS];
+    int weight[MAX_KERNELS];
+    int num_kernels, n, k;
+
+    num_kernels = args.num_kernels;
+    for (n = 0; n < num_kernels; n++) {
+	kernel[n] = args.kernel[n];
+	weight[n] = args.weight[n];
+    }
+
+    for (n = 0; n < num_kernels; n++) {
+	args.num_kernels = 1;
+	args.kernel[0] = kernel[n];
+	args.weight[0] = weight[n];
+	base_work = -1;
+	base_evrate = -1.0;
+
+	printf("\n========== kernel: %s ==========\n", kernel[n]->name);
+	run_test();
+
+	for (k = 0; Threshold[k] >= 0; k++) {
+	    EachOverhead[n][k] = Overhead[k];
+	    EachThrottle[n][k] = Throttle[k];
+	}
+    }
+
+    printf("\nOverhead and Throttle test, by kernel (overhead %% / throttle %%)\n\n");
+    printf("%15s", args.name[0]);
+    for (n = 0; n < num_kernels; n++) {
+	printf("  %15s", kernel[n]->name);
+    }
+    printf("\n");
+    for (k = 0; Threshold[k] >= 0; k++) {
+	printf("%15ld", Threshold[k]);
+	for (n = 0; n < num_kernels; n++) {
+	    printf("  %7.1f %7.1f", EachOverhead[n][k], EachThrottle[n][k]);
+	}
+	printf("\n");
+    }
+    printf("\n");
+
+    args.num_kernels = num_kernels;
+    for (n = 0; n < num_kernels; n++) {
+	args.kernel[n] = kernel[n];
+	args.weight[n] = weight[n];
+    }
+}
+
+/*
+ *  Run the sweep once per recursion depth and summarize the overhead
+ *  and the frames unwound per sample for each depth side by side.
+ */
+void
+run_each_depth(void)
+{
+    int n, k;
+
+    for (n = 0; n < args.num_depths; n++) {
+	args.stack_depth = args.depth[n];
+	base_work = -1;
+	base_evrate = -1.0;
+
+	printf("\n========== stack depth: %d ==========\n", args.depth[n]);
+	run_test();
+
+	for (k = 0; Threshold[k] >= 0; k++) {
+	    DepthOverhead[n][k] = Overhead[k];
+	    DepthFrames[n][k] = Frames[k];
+	}
+    }
+
+    printf("\nOverhead and Throttle test, by stack depth, unwind: %s "
+	   "(overhead %% / frames)\n\n", unwind_mode_name(args.unwind_mode));
+    printf("%15s", args.name[0]);
+    for (n = 0; n < args.num_depths; n++) {
+	printf("  %15d", args.depth[n]);
+    }
+    printf("\n");
+    for (k = 0; Threshold[k] >= 0; k++) {
+	printf("%15ld", Threshold[k]);
+	for (n = 0; n < args.num_depths; n++) {
+	    printf("  %7.1f %7.1f", DepthOverhead[n][k], DepthFrames[n][k]);
+	}
+	printf("\n");
+    }
+    printf("\n");
+}
+
 int
 main(int argc, char **argv)
 {
@@ -178,13 +335,38 @@ main(int argc, char **argv)
     if (args.num_events == 0) {
 	TOT_CYC_DEFAULT(args);
     }
+    if (args.num_depths > 0) {
+	if (args.each_kernel)
+	    errx(1, "use either -e or -D, not both");
+	if (args.unwind_mode == UNWIND_NONE)
+	    args.unwind_mode = UNWIND_FP;
+	if (args.num_kernels == 0)
+	    add_kernels(&args, "recurse");
+    }
+    set_default_kernels(&args, 0);
     args.prog_time = MAX(args.prog_time, MIN_TIME);
     args.num_events = 1;
     args.threshold[0] = 0;
 
     printf("Overhead and Throttle test, time: %d\n", args.prog_time);
+    print_kernel_list(&args);
+    if (args.unwind_mode != UNWIND_NONE) {
+	printf("unwind: %s, max frames: %d, stack depth: %d\n",
+	       unwind_mode_name(args.unwind_mode), args.unwind_max,
+	       args.stack_depth);
+    }
+    unwind_thread_init(args.unwind_mode);
+
+    init_kernels(&args);
+    init_thread_kernels(&args, &memstate);
+    print_memory_info(&memstate, -1);
 
-    run_test();
+    if (args.each_kernel)
+	run_each_kernel();
+    else if (args.num_depths > 0)
+	run_each_depth();
+    else
+	run_test();
 
     return 0;
 }
@@ -0,0 +1,276 @@
+/*
+ *  CPU topology from /sys/devices/system/cpu and thread placement.
+ *
+ *  With -P policy, each thread pins itself to one CPU before it
+ *  allocates memory or starts its counters, so that per-thread
+ *  results don't depend on where the scheduler puts the threads:
+ *
+ *    compact  fill the physical cores of one package, then their SMT
+ *             siblings, then the next package
+ *    scatter  round robin over the packages, one thread per physical
+ *             core before any SMT siblings
+ *    core     one thread per physical core (first SMT sibling only)
+ *    smt      fill all the SMT siblings of one core before the next
+ *
+ *  Only the CPUs that are online and in the process's affinity mask
+ *  are used.  If there are more threads than CPUs in the order, the
+ *  threads wrap around.
+ *
+ *  Without -P, nothing is pinned, but the tests still report the CPU
+ *  each thread last ran on and how many times it moved.
+ *
+ *  Copyright (c) 2009-2013, Rice University.
+ *  See the file LICENSE for details.
+ */
+
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "papi-tests.h"
+
+#define MAX_CPUS  1024
+#define SYS_CPU_DIR  "/sys/devices/system/cpu"
+
+struct cpu_info {
+    int cpu;
+    int package;
+    int core;
+    int rank;
+    int smt;
+};
+
+static char *pin_names[] = { "none", "compact", "scatter", "core", "smt" };
+
+static struct cpu_info cpu_list[MAX_CPUS];
+static int num_cpus = 0;
+static int cpu_order[MAX_CPUS];
+static int num_order = 0;
+static int num_packages = 0;
+static int num_cores = 0;
+static int pin_policy = PIN_NONE;
+
+static volatile int last_cpu[MAX_THREADS];
+static volatile long moves[MAX_THREADS];
+
+char *
+pin_policy_name(int policy)
+{
+    return (policy >= PIN_NONE && policy <= PIN_SMT)
+	? pin_names[policy] : "unknown";
+}
+
+void
+parse_pin_policy(struct prog_args *args, char *arg)
+{
+    int policy;
+
+    for (policy = PIN_NONE; policy <= PIN_SMT; policy++) {
+	if (strcmp(arg, pin_names[policy]) == 0) {
+	    args->pin_policy = policy;
+	    return;
+	}
+    }
+    errx(1, "invalid placement policy: %s", arg);
+}
+
+/*
+ *  Returns: the integer in the sysfs file, or -1 if not readable.
+ */
+static int
+read_sys_int(int cpu, char *name)
+{
+    char path[200];
+    FILE *fp;
+    int val;
+
+    snprintf(path, sizeof(path), "%s/cpu%d/%s", SYS_CPU_DIR, cpu, name);
+    fp = fopen(path, "r");
+    if (fp == NULL)
+	return -1;
+    if (fscanf(fp, "%d", &val) < 1)
+	val = -1;
+    fclose(fp);
+    return val;
+}
+
+static int
+cmp_cpu(const void *a, const void *b)
+{
+    const struct cpu_info *x = &cpu_list[*(const int *) a];
+    const struct cpu_info *y = &cpu_list[*(const int *) b];
+    int key_x[3], key_y[3], k;
+
+    switch (pin_policy) {
+    case PIN_SCATTER:
+	key_x[0] = x->smt;  key_x[1] = x->rank;  key_x[2] = x->package;
+	key_y[0] = y->smt;  key_y[1] = y->rank;  key_y[2] = y->package;
+	break;
+    case PIN_SMT:
+	key_x[0] = x->package;  key_x[1] = x->rank;  key_x[2] = x->smt;
+	key_y[0] = y->package;  key_y[1] = y->rank;  key_y[2] = y->smt;
+	break;
+    default:
+	key_x[0] = x->package;  key_x[1] = x->smt;  key_x[2] = x->rank;
+	key_y[0] = y->package;  key_y[1] = y->smt;  key_y[2] = y->rank;
+	break;
+    }
+    for (k = 0; k < 3; k++) {
+	if (key_x[k] != key_y[k])
+	    return (key_x[k] < key_y[k]) ? -1 : 1;
+    }
+    return x->cpu - y->cpu;
+}
+
+/*
+ *  Read the topology of the usable CPUs and put them in the order for
+ *  args->pin_policy.  Call once, before the threads start.
+ */
+void
+topology_init(struct prog_args *args)
+{
+    struct cpu_info *c, *d;
+    cpu_set_t mask;
+    int cpu, k, j, online;
+
+    for (k = 0; k < MAX_THREADS; k++) {
+	last_cpu[k] = -1;
+	moves[k] = 0;
+    }
+    pin_policy = args->pin_policy;
+    if (pin_policy == PIN_NONE)
+	return;
+
+    CPU_ZERO(&mask);
+    if (sched_getaffinity(0, sizeof(mask), &mask) != 0)
+	err(1, "sched_getaffinity failed");
+
+    num_cpus = 0;
+    for (cpu = 0; cpu < MAX_CPUS && cpu < CPU_SETSIZE; cpu++) {
+	if (! CPU_ISSET(cpu, &mask))
+	    continue;
+	/* cpu0 often has no online file. */
+	online = read_sys_int(cpu, "online");
+	if (online == 0)
+	    continue;
+	c = &cpu_list[num_cpus++];
+	c->cpu = cpu;
+	c->package = read_sys_int(cpu, "topology/physical_package_id");
+	c->core = read_sys_int(cpu, "topology/core_id");
+	if (c->package < 0 || c->core < 0) {
+	    c->package = 0;
+	    c->core = cpu;
+	}
+    }
+    if (num_cpus == 0)
+	errx(1, "no usable cpus for placement");
+
+    /*
+     * Rank is the core's index in its package, and smt is the cpu's
+     * index among its core's siblings.
+     */
+    num_packages = 0;
+    num_cores = 0;
+    for (k = 0; k < num_cpus; k++) {
+	c = &cpu_list[k];
+	c->smt = 0;
+	for (j = 0; j < k; j++) {
+	    d = &cpu_list[j];
+	    if (d->package == c->package && d->core == c->core)
+		c->smt++;
+	}
+	for (j = 0; j < k; j++) {
+	    if (cpu_list[j].package == c->package)
+		break;
+	}
+	if (j == k)
+	    num_packages++;
+	if (c->smt == 0)
+	    num_cores++;
+    }
+    for (k = 0; k < num_cpus; k++) {
+	c = &cpu_list[k];
+	c->rank = 0;
+	for (j = 0; j < num_cpus; j++) {
+	    d = &cpu_list[j];
+	    if (d->package == c->package && d->smt == 0 && d->core < c->core)
+		c->rank++;
+	}
+    }
+
+    num_order = 0;
+    for (k = 0; k < num_cpus; k++) {
+	if (pin_policy == PIN_CORE && cpu_list[k].smt > 0)
+	    continue;
+	cpu_order[num_order++] = k;
+    }
+    qsort(cpu_order, num_order, sizeof(int), cmp_cpu);
+
+    printf("placement: %s, cpus: %d, packages: %d, cores: %d\n",
+	   pin_policy_name(pin_policy), num_cpus, num_packages, num_cores);
+    if (args->num_threads > num_order) {
+	printf("placement: %d threads on %d cpus, threads will share cpus\n",
+	       args->num_threads, num_order);
+    }
+}
+
+/*
+ *  Pin the calling thread to its CPU in the order.  Returns: the CPU,
+ *  or -1 if not pinned.
+ */
+int
+topology_pin(int tid)
+{
+    struct cpu_info *c;
+    cpu_set_t set;
+
+    if (pin_policy == PIN_NONE || num_order == 0)
+	return -1;
+
+    c = &cpu_list[cpu_order[tid % num_order]];
+    CPU_ZERO(&set);
+    CPU_SET(c->cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+	errx(1, "unable to pin thread %d to cpu %d", tid, c->cpu);
+
+    printf("tid: %d, pinned to cpu: %d (package: %d, core: %d, smt: %d)\n",
+	   tid, c->cpu, c->package, c->core, c->smt);
+    last_cpu[tid] = c->cpu;
+    return c->cpu;
+}
+
+/*
+ *  Note the CPU the calling thread is on now, and count a move if it
+ *  changed.  Cheap enough to call once per unit of work.
+ */
+void
+topology_check_cpu(int tid)
+{
+    int cpu = sched_getcpu();
+
+    if (tid < 0 || tid >= MAX_THREADS || cpu < 0)
+	return;
+    if (cpu != last_cpu[tid]) {
+	if (last_cpu[tid] >= 0)
+	    moves[tid]++;
+	last_cpu[tid] = cpu;
+    }
+}
+
+int
+topology_last_cpu(int tid)
+{
+    return last_cpu[tid];
+}
+
+long
+topology_moves(int tid)
+{
+    return moves[tid];
+}
@@ -0,0 +1,238 @@
+/*
+ *  Unwind the call stack in the overflow handler, the way a profiler
+ *  that records full call paths does, and a kernel with recursion of
+ *  controlled depth to unwind through.
+ *
+ *  With -U mode[:max], the handler unwinds from the interrupted
+ *  context toward the base of the stack, at most max frames (default
+ *  MAX_UNWIND_DEPTH), and stores the return addresses in a per-thread
+ *  buffer:
+ *
+ *    fp     walk the frame pointer chain from the context's rbp,
+ *           checking that each frame is on the thread's stack
+ *           (x86-64 only, and only frames with frame pointers)
+ *    table  glibc backtrace(), which uses the libgcc unwinder and the
+ *           .eh_frame tables, starting from the handler's own frame
+ *
+ *  The recurse kernel calls itself -D deep before each unit of work,
+ *  so every sample has that many frames under it.  The kernels, the
+ *  utility files and throttle are built with frame pointers, so the fp
+ *  walk goes through the recursion, run_kernels() and the test up to
+ *  main().  It stops at the first frame without a frame pointer, which
+ *  is usually libc's start code.
+ *
+ *  Copyright (c) 2009-2013, Rice University.
+ *  See the file LICENSE for details.
+ */
+
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <err.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+#include "papi-tests.h"
+
+#define RECURSE_SCALE  400000
+
+static __thread unsigned long stack_lo = 0;
+static __thread unsigned long stack_hi = 0;
+static __thread void *unwind_buf[MAX_UNWIND_DEPTH];
+
+static char *unwind_names[] = { "none", "fp", "table" };
+
+char *
+unwind_mode_name(int mode)
+{
+    return (mode >= UNWIND_NONE && mode <= UNWIND_TABLE)
+	? unwind_names[mode] : "unknown";
+}
+
+/*
+ *  Parse mode[:max] for -U.
+ */
+void
+parse_unwind_mode(struct prog_args *args, char *arg)
+{
+    char *buf, *colon;
+    int mode, max;
+
+    buf = strdup(arg);
+    max = MAX_UNWIND_DEPTH;
+    colon = strchr(buf, ':');
+    if (colon != NULL) {
+	*colon = 0;
+	if (sscanf(colon + 1, "%d", &max) < 1 || max < 1
+	    || max > MAX_UNWIND_DEPTH)
+	    errx(1, "invalid argument for unwind depth: %s", colon + 1);
+    }
+
+    for (mode = UNWIND_NONE; mode <= UNWIND_TABLE; mode++) {
+	if (strcmp(buf, unwind_names[mode]) == 0) {
+	    args->unwind_mode = mode;
+	    args->unwind_max = max;
+	    free(buf);
+	    return;
+	}
+    }
+    errx(1, "invalid unwind mode: %s", arg);
+}
+
+/*
+ *  Parse a comma-separated list of stack depths for -D.
+ */
+void
+parse_stack_depths(struct prog_args *args, char *arg)
+{
+    char *buf, *name, *save;
+    int depth;
+
+    args->num_depths = 0;
+    buf = strdup(arg);
+    for (name = strtok_r(buf, ",", &save); name != NULL;
+	 name = strtok_r(NULL, ",", &save))
+    {
+	if (args->num_depths >= MAX_DEPTHS)
+	    errx(1, "too many stack depths: %s", arg);
+	if (sscanf(name, "%d", &depth) < 1 || depth < 0
+	    || depth > MAX_UNWIND_DEPTH)
+	    errx(1, "invalid argument for stack depth: %s", name);
+	args->depth[args->num_depths++] = depth;
+    }
+    free(buf);
+
+    if (args->num_depths == 0)
+	errx(1, "invalid argument for stack depth: %s", arg);
+    args->stack_depth = args->depth[0];
+}
+
+/*
+ *  Find the bounds of this thread's stack for the fp walk, and for
+ *  table, run backtrace() once so that libgcc is loaded now and not
+ *  in the handler.  Call in each thread before PAPI_start().
+ */
+void
+unwind_thread_init(int mode)
+{
+    pthread_attr_t attr;
+    void *addr;
+    size_t size;
+
+    if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+	if (pthread_attr_getstack(&attr, &addr, &size) == 0) {
+	    stack_lo = (unsigned long) addr;
+	    stack_hi = (unsigned long) addr + size;
+	}
+	pthread_attr_destroy(&attr);
+    }
+    if (mode == UNWIND_TABLE)
+	backtrace(unwind_buf, 1);
+}
+
+/*
+ *  Unwind from the handler's context, at most max frames, async signal
+ *  safe for fp.  Returns: the number of frames, including the PC.
+ */
+int
+unwind_stack(int mode, int max, void *context)
+{
+#ifdef __x86_64__
+    ucontext_t *uc = context;
+    unsigned long fp, sp, next;
+#endif
+    int n = 0;
+
+    max = MAX(1, MIN(max, MAX_UNWIND_DEPTH));
+    if (mode == UNWIND_TABLE)
+	return backtrace(unwind_buf, max);
+
+#ifdef __x86_64__
+    if (mode != UNWIND_FP || uc == NULL)
+	return 0;
+
+    unwind_buf[n++] = (void *) uc->uc_mcontext.gregs[REG_RIP];
+    fp = uc->uc_mcontext.gregs[REG_RBP];
+    sp = uc->uc_mcontext.gregs[REG_RSP];
+
+    /* Each frame is (saved rbp, return address) at fp. */
+    while (n < max && fp >= sp && fp >= stack_lo
+	   && fp + 2 * sizeof(long) <= stack_hi && fp % sizeof(long) == 0)
+    {
+	if (((unsigned long *) fp)[1] == 0)
+	    break;
+	unwind_buf[n++] = (void *) ((unsigned long *) fp)[1];
+	next = ((unsigned long *) fp)[0];
+	if (next <= fp)
+	    break;
+	fp = next;
+    }
+#endif
+
+    return n;
+}
+
+/*
+ *  Recursion for the recurse kernel.  The add after the call keeps it
+ *  from being a tail call, so each level is a real frame.
+ */
+static struct prog_args *recurse_args = NULL;
+
+static double __attribute__ ((noinline))
+recurse(int depth, long scale)
+{
+    volatile int level = depth;
+    double y, sum;
+    long n;
+
+    if (depth > 0) {
+	sum = recurse(depth - 1, scale);
+	return sum + (level - depth);
+    }
+
+    sum = 0.0;
+    y = 0.0;
+    for (n = 1; n < scale; n++) {
+	y += 1.0;
+	sum += y;
+    }
+    return sum;
+}
+
+static void
+recurse_init(struct prog_args *args)
+{
+    recurse_args = args;
+}
+
+/*
+ *  Each unit recurses -D deep and adds 1 + 2 + ... + (scale - 1) at
+ *  the bottom, which is exact in a double.
+ */
+static int
+recurse_run(struct memory_state *mstate, int work)
+{
+    double sum, expect;
+    int num_errs = 0;
+
+    expect = (double) (recurse_kernel.scale - 1) * recurse_kernel.scale / 2;
+    for (; work > 0; work--) {
+	sum = recurse(recurse_args->stack_depth, recurse_kernel.scale);
+	if (sum != expect) {
+	    warnx("%s: sum is out of range: %g", __func__, sum);
+	    num_errs++;
+	}
+    }
+
+    return (num_errs);
+}
+
+struct work_kernel recurse_kernel = {
+    "recurse", "scalar adds under -D levels of recursion",
+    "PAPI_TOT_CYC PAPI_TOT_INS",
+    recurse_init, NULL, NULL, recurse_run, RECURSE_SCALE, 0, 0, 0, 0, 0,
+};
@@ -15,11 +15,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "papi-tests.h"
 
-#define OPT_ARG_STR  "1hm:o:p:rs:t:vw:x:z"
+#define OPT_ARG_STR  "1a:b:cehg:k:m:o:p:rs:t:u:vw:x:zD:H:I:LN:P:R:T:U:W:"
 
 void
 usage(char *name)
@@ -28,12 +29,19 @@ usage(char *name)
 	   "       %s [-%s] sec usec [sec usec]\n\n"
 	   "    -1\n"
 	   "\tPrint output from one thread only.\n\n"
+	   "    -c\n"
+	   "\tRecalibrate the kernels, ignoring the calibration file.\n\n"
+	   "    -e\n"
+	   "\tRun each -k kernel separately, for the throttle test.\n\n"
 	   "    -h\n"
 	   "\tPrint this usage message.\n\n"
+	   "    -k <name[:weight],...>\n"
+	   "\tWorkload kernels to run and their relative weights (default\n"
+	   "\tflops, plus memory if memsize > 0).  May be repeated.\n\n"
 	   "    -m <num>\n"
 	   "\tSize of array (per thread) in Megabytes for the memory cache\n"
-	   "\ttests.  Must be between 1 and 2000, or else 0 to disable the\n"
-	   "\tmemory tests (default %d).\n\n"
+	   "\ttests.  Must be between 1 and 2000 (or more with -L), or else\n"
+	   "\t0 to disable the memory tests (default %d).\n\n"
 	   "    -o <num>\n"
 	   "\tThe default overflow threshold (default %d).\n\n"
 	   "    -p <num>\n"
@@ -44,16 +52,62 @@ usage(char *name)
 	   "\tTime in seconds to stagger starting side threads (default %d).\n\n"
 	   "    -t <num>\n"
 	   "\tTime to run the tests in seconds (default %d).\n\n"
+	   "    -u <num>\n"
+	   "\tCalibrate the kernels so that one unit of work takes this many\n"
+	   "\tmicroseconds, or 0 to use the built-in scales (default %d).\n\n"
 	   "    -v\n"
 	   "\tMore verbose output per time step.\n\n"
 	   "    -w <num>\n"
-	   "\tAmount of work per iteration (default %d).  The unit of work\n"
-	   "\tis arbitrary, but 1000 units takes roughly a few seconds.\n\n"
+	   "\tAmount of work per iteration (default %d).  With the default\n"
+	   "\tcalibration, 1000 units takes about one second.\n\n"
 	   "    -x <num>\n"
 	   "\tNumber of loop iterations in the overflow handler (default %d).\n"
 	   "\tOnly applies to the handler test.\n\n"
 	   "    -z\n"
-	   "\tAdd sleep (zzz) to the timer tests.\n\n",
+	   "\tAdd sleep (zzz) to the timer tests.\n\n"
+	   "    -H <mode,...>\n"
+	   "\tPage mode for the memory array: hugetlb (MAP_HUGETLB), thp\n"
+	   "\t(madvise huge pages), nothp (madvise no huge pages), populate\n"
+	   "\t(MAP_POPULATE) and/or lock (mlock).  Default is plain pages.\n\n"
+	   "    -L\n"
+	   "\tLarge memory mode: 64-bit indices and a 2^64 period generator\n"
+	   "\tfor the memory kernel, allows -m above 2000.\n\n"
+	   "    -N <policy>\n"
+	   "\tNUMA policy for the memory array: local (node of the thread),\n"
+	   "\tinterleave (all nodes) or remote (next node).  Default is to\n"
+	   "\tlet the kernel decide.\n\n"
+	   "    -I <num>[,nt]\n"
+	   "\tInitialize the memory array with num threads, and with nt,\n"
+	   "\tnon-temporal stores (x86-64 only).  Default is 1 thread.\n\n"
+	   "    -a <pattern>\n"
+	   "\tAccess pattern for the walk kernel: seq, stride:N (lines),\n"
+	   "\trandom or chase (dependent loads).  Default is random.\n\n"
+	   "    -W <kB>\n"
+	   "\tWorking set for the walk kernel in kB.  Default is the -m size.\n\n"
+	   "    -b <pct>\n"
+	   "\tPercent of random branches in the branch kernel, 0 (always\n"
+	   "\tpredicted) to 100 (coin flip).  Default is 50.\n\n"
+	   "    -g <num>\n"
+	   "\tSharing degree for the share and false-share kernels, threads\n"
+	   "\tper cache line.  Default is all threads.\n\n"
+	   "    -R <size>\n"
+	   "\tRecord each interrupt (PC, time, overflow vector, thread) in\n"
+	   "\ta per-thread ring of size samples, drained by a consumer\n"
+	   "\tthread.  Default is off (count only).\n\n"
+	   "    -P <policy>\n"
+	   "\tPin each thread to a cpu (threads, thread-over and timer\n"
+	   "\ttests): compact, scatter, core (one per physical core) or smt\n"
+	   "\t(fill SMT siblings first).  Default is no pinning.\n\n"
+	   "    -T <num,...> | cores\n"
+	   "\tThread counts for the thread-over and setup-lat sweeps, or\n"
+	   "\tcores for 1, 2, 4, ... up to the number of online cpus.\n\n"
+	   "    -U <mode>[:max]\n"
+	   "\tUnwind the call stack in the handler: fp (frame pointers,\n"
+	   "\tx86-64 only) or table (backtrace), at most max frames.\n"
+	   "\tDefault is none.\n\n"
+	   "    -D <depth,...>\n"
+	   "\tRecursion depth for the recurse kernel (default %d).  For the\n"
+	   "\tthrottle test, run the sweep once for each depth.\n\n",
 	   name, OPT_ARG_STR,
 	   name, OPT_ARG_STR,
 	   DEFAULT_MEMSIZE,
@@ -61,13 +115,16 @@ usage(char *name)
 	   DEFAULT_NUM_THREADS,
 	   DEFAULT_STAGGER_DELAY,
 	   DEFAULT_PROG_TIME,
+	   DEFAULT_UNIT_USEC,
 	   DEFAULT_WORK,
-	   DEFAULT_HANDLER_ITER);
+	   DEFAULT_HANDLER_ITER,
+	   DEFAULT_STACK_DEPTH);
 
     printf("EVENT can be a PAPI preset event (eg, PAPI_TOT_CYC) or a native event\n"
 	   "(eg, UNHALTED_CORE_CYCLES).  PERIOD is the overflow threshold.  The\n"
 	   "delimiter between EVENT and PERIOD may be colon (:) or at-sign (@).\n"
 	   "\nNot all options apply to every program.\n");
+    list_kernels();
 }
 
 void
@@ -84,13 +141,98 @@ set_default_args(struct prog_args *args)
     args->stagger_delay = DEFAULT_STAGGER_DELAY;
     args->verbose = 0;
     args->num_events = 0;
+    args->num_kernels = 0;
     args->sleep = 0;
+    args->unit_usec = DEFAULT_UNIT_USEC;
+    args->recalibrate = 0;
+    args->init_threads = 1;
+    args->init_stream = 0;
+    args->walk_pattern = WALK_RANDOM;
+    args->walk_stride = 1;
+    args->walk_kb = 0;
+    args->branch_pct = DEFAULT_BRANCH_PCT;
+    args->unwind_mode = UNWIND_NONE;
+    args->unwind_max = MAX_UNWIND_DEPTH;
+    args->stack_depth = DEFAULT_STACK_DEPTH;
+}
+
+/*
+ *  Parse a comma-separated list of page modes for -H.
+ */
+static int
+parse_page_mode(char *arg)
+{
+    char *buf, *name, *save;
+    int mode;
+
+    mode = 0;
+    buf = strdup(arg);
+    for (name = strtok_r(buf, ",", &save); name != NULL;
+	 name = strtok_r(NULL, ",", &save))
+    {
+	if (strcmp(name, "hugetlb") == 0)
+	    mode |= PAGE_HUGETLB;
+	else if (strcmp(name, "thp") == 0)
+	    mode |= PAGE_THP;
+	else if (strcmp(name, "nothp") == 0)
+	    mode |= PAGE_NOTHP;
+	else if (strcmp(name, "populate") == 0)
+	    mode |= PAGE_POPULATE;
+	else if (strcmp(name, "lock") == 0)
+	    mode |= PAGE_LOCK;
+	else if (strcmp(name, "none") != 0)
+	    errx(1, "invalid page mode: %s", name);
+    }
+    free(buf);
+
+    if ((mode & PAGE_THP) && (mode & (PAGE_NOTHP | PAGE_HUGETLB)))
+	errx(1, "page mode thp conflicts with nothp and hugetlb: %s", arg);
+
+    return mode;
+}
+
+/*
+ *  Parse the list of thread counts for -T, or cores for the powers of
+ *  two up to the number of online cpus (and that number itself).
+ */
+static void
+parse_thread_sweep(struct prog_args *args, char *arg)
+{
+    char *buf, *name, *save;
+    long ncpus;
+    int num;
+
+    args->num_sweep = 0;
+    if (strcmp(arg, "cores") == 0) {
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	ncpus = MAX(1, MIN(ncpus, MAX_THREADS));
+	for (num = 1; num < ncpus && args->num_sweep < MAX_SWEEP - 1; num *= 2)
+	    args->sweep[args->num_sweep++] = num;
+	args->sweep[args->num_sweep++] = ncpus;
+	return;
+    }
+
+    buf = strdup(arg);
+    for (name = strtok_r(buf, ",", &save); name != NULL;
+	 name = strtok_r(NULL, ",", &save))
+    {
+	if (args->num_sweep >= MAX_SWEEP)
+	    errx(1, "too many thread counts: %s", arg);
+	if (sscanf(name, "%d", &num) < 1 || num < 1 || num > MAX_THREADS)
+	    errx(1, "invalid argument for thread count: %s", name);
+	args->sweep[args->num_sweep++] = num;
+    }
+    free(buf);
+
+    if (args->num_sweep == 0)
+	errx(1, "invalid argument for thread count: %s", arg);
 }
 
 int
 parse_args(struct prog_args *args, int argc, char **argv)
 {
     int c, ret;
+    char *p;
 
     optind = 1;
     while ((c = getopt(argc, argv, OPT_ARG_STR)) != -1) {
@@ -101,16 +243,53 @@ parse_args(struct prog_args *args, int argc, char **argv)
 	    args->single = 1;
 	    break;
 
+	/* access pattern for walk kernel */
+	case 'a':
+	    parse_walk_pattern(args, optarg);
+	    break;
+
+	/* percent random branches for branch kernel */
+	case 'b':
+	    ret = sscanf(optarg, "%d", &args->branch_pct);
+	    if (ret < 1 || args->branch_pct < 0 || args->branch_pct > 100) {
+		errx(1, "invalid argument for branch percent: %s", optarg);
+	    }
+	    break;
+
+	/* recalibrate kernels */
+	case 'c':
+	    args->recalibrate = 1;
+	    break;
+
+	/* threads per line for share kernels */
+	case 'g':
+	    ret = sscanf(optarg, "%d", &args->share_degree);
+	    if (ret < 1 || args->share_degree < 1) {
+		errx(1, "invalid argument for sharing degree: %s", optarg);
+	    }
+	    break;
+
+	/* run each kernel separately */
+	case 'e':
+	    args->each_kernel = 1;
+	    break;
+
 	/* display help */
 	case 'h':
 	    usage(argv[0]);
 	    exit(0);
 	    break;
 
+	/* workload kernels and weights */
+	case 'k':
+	    add_kernels(args, optarg);
+	    break;
+
 	/* size of memory array in megs */
 	case 'm':
 	    ret = sscanf(optarg, "%d", &args->memsize);
-	    if (ret < 1 || args->memsize < 0 || args->memsize > 2000) {
+	    if (ret < 1 || args->memsize < 0
+		|| args->memsize > MAX_LARGE_MEMSIZE) {
 		errx(1, "invalid argument for memsize: %s", optarg);
 	    }
 	    break;
@@ -154,6 +333,15 @@ parse_args(struct prog_args *args, int argc, char **argv)
 	    }
 	    break;
 
+	/* calibrated time per unit of work in usec */
+	case 'u':
+	    ret = sscanf(optarg, "%d", &args->unit_usec);
+	    if (ret < 1 || args->unit_usec < 0
+		|| (args->unit_usec > 0 && args->unit_usec < 10)) {
+		errx(1, "invalid argument for usec per unit: %s", optarg);
+	    }
+	    break;
+
 	/* verbose mode per time step */
 	case 'v':
 	    args->verbose = 1;
@@ -180,11 +368,146 @@ parse_args(struct prog_args *args, int argc, char **argv)
 	    args->sleep = 1;
 	    break;
 
+	/* page mode for memory array */
+	case 'H':
+	    args->page_mode = parse_page_mode(optarg);
+	    break;
+
+	/* threads and stores for filling memory array */
+	case 'I':
+	    ret = sscanf(optarg, "%d", &args->init_threads);
+	    if (ret < 1 || args->init_threads < 1
+		|| args->init_threads > MAX_INIT_THREADS) {
+		errx(1, "invalid argument for init threads: %s", optarg);
+	    }
+	    p = strchr(optarg, ',');
+	    if (p != NULL && strcmp(p + 1, "nt") == 0)
+		args->init_stream = 1;
+	    else if (p != NULL)
+		errx(1, "invalid init option: %s", optarg);
+	    break;
+
+	/* working set for walk kernel */
+	case 'W':
+	    ret = sscanf(optarg, "%ld", &args->walk_kb);
+	    if (ret < 1 || args->walk_kb < 4) {
+		errx(1, "invalid argument for working set: %s", optarg);
+	    }
+	    break;
+
+	/* large memory mode, 64-bit indices */
+	case 'L':
+	    args->large_mem = 1;
+	    break;
+
+	/* record samples in per-thread rings */
+	case 'R':
+	    ret = sscanf(optarg, "%ld", &args->ring_size);
+	    if (ret < 1 || args->ring_size < 1) {
+		errx(1, "invalid argument for ring size: %s", optarg);
+	    }
+	    break;
+
+	/* thread placement policy */
+	case 'P':
+	    parse_pin_policy(args, optarg);
+	    break;
+
+	/* thread counts for thread-over sweep */
+	case 'T':
+	    parse_thread_sweep(args, optarg);
+	    break;
+
+	/* unwind the stack in the handler */
+	case 'U':
+	    parse_unwind_mode(args, optarg);
+	    break;
+
+	/* recursion depths for recurse kernel */
+	case 'D':
+	    parse_stack_depths(args, optarg);
+	    break;
+
+	/* NUMA policy for memory array */
+	case 'N':
+	    if (strcmp(optarg, "local") == 0)
+		args->numa_policy = NUMA_LOCAL;
+	    else if (strcmp(optarg, "interleave") == 0)
+		args->numa_policy = NUMA_INTERLEAVE;
+	    else if (strcmp(optarg, "remote") == 0)
+		args->numa_policy = NUMA_REMOTE;
+	    else if (strcmp(optarg, "none") == 0)
+		args->numa_policy = NUMA_NONE;
+	    else
+		errx(1, "invalid NUMA policy: %s", optarg);
+	    break;
+
 	default:
 	    usage(argv[0]);
 	    exit(1);
 	}
     }
 
+    if (args->memsize > MAX_MEMSIZE && ! args->large_mem) {
+	errx(1, "memsize above %d meg requires large memory mode (-L)",
+	     MAX_MEMSIZE);
+    }
+
     return optind;
 }
+
+static int
+cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+
+    return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+void
+sort_doubles(double *val, long num)
+{
+    qsort(val, num, sizeof(double), cmp_double);
+}
+
+/*
+ *  Returns: the pct percentile (0 to 100) of the num values in val,
+ *  which must be sorted, by nearest rank, or 0.0 if num is 0.
+ */
+double
+percentile(double *val, long num, double pct)
+{
+    long k;
+
+    if (num <= 0)
+	return 0.0;
+    k = (long) (pct * num / 100.0 + 0.999999) - 1;
+    return val[MAX(0, MIN(k, num - 1))];
+}
+
+/*
+ *  Sort the num latencies (usec) in lat and print one row of a latency
+ *  table: count, min, p50, p90, p99 and max.
+ */
+void
+print_latency(char *name, double *lat, long num)
+{
+    sort_doubles(lat, num);
+    printf("%-14s  %8ld  %8.1f  %8.1f  %8.1f  %8.1f  %8.1f\n", name, num,
+	   percentile(lat, num, 0.0), percentile(lat, num, 50.0),
+	   percentile(lat, num, 90.0), percentile(lat, num, 99.0),
+	   percentile(lat, num, 100.0));
+}
+
+/*
+ *  Returns: nanoseconds from CLOCK_MONOTONIC, async signal safe.
+ */
+long
+time_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return 1000000000L * ts.tv_sec + ts.tv_nsec;
+}
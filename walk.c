@@ -0,0 +1,193 @@
+/*
+ *  Kernel that walks a working set with a chosen access pattern.
+ *
+ *  The memory kernel only does uniform random reads and writes over
+ *  the whole -m array.  The walk kernel touches one cache line per
+ *  access over a working set of -W kB (default the -m size) with one
+ *  of four patterns (-a):
+ *
+ *    seq         each line in order, prefetch friendly
+ *    stride:N    every N-th line, wrapping around
+ *    random      independent random lines
+ *    chase       dependent loads around a random cycle of all lines
+ *
+ *  Seq, stride and random read and write each line and are bandwidth
+ *  bound for large sets, chase only reads and is latency bound.  The
+ *  mem-sweep test steps the working set from L1 out to DRAM.
+ *
+ *  Copyright (c) 2009-2013, Rice University.
+ *  See the file LICENSE for details.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "papi-tests.h"
+
+#define WALK_LINE    64
+#define WALK_SCALE   1000000
+
+struct walk_line {
+    long next;
+    long val;
+    char pad[WALK_LINE - 2 * sizeof(long)];
+};
+
+static char *pattern_name[] = { "seq", "stride", "random", "chase" };
+
+static int walk_pattern;
+static long walk_stride;
+
+char *
+walk_pattern_name(int pattern)
+{
+    return (pattern >= 0 && pattern <= WALK_CHASE) ? pattern_name[pattern] : "?";
+}
+
+/*
+ *  Parse the -a argument: seq, stride:N, random or chase.
+ */
+void
+parse_walk_pattern(struct prog_args *args, char *str)
+{
+    int k;
+
+    if (strncmp(str, "stride:", 7) == 0 || strncmp(str, "stride@", 7) == 0) {
+	args->walk_pattern = WALK_STRIDE;
+	args->walk_stride = atoi(str + 7);
+	if (args->walk_stride < 1)
+	    errx(1, "invalid stride: %s", str + 7);
+	return;
+    }
+    for (k = 0; k <= WALK_CHASE; k++) {
+	if (k != WALK_STRIDE && strcmp(str, pattern_name[k]) == 0) {
+	    args->walk_pattern = k;
+	    return;
+	}
+    }
+    errx(1, "invalid access pattern: %s", str);
+}
+
+static void
+walk_init(struct prog_args *args)
+{
+    walk_pattern = args->walk_pattern;
+    walk_stride = (walk_pattern == WALK_STRIDE) ? args->walk_stride : 1;
+}
+
+/*
+ *  Allocate the lines and link them into one random cycle with
+ *  Sattolo's algorithm, so the chase visits every line before
+ *  repeating and the hardware can't predict the next address.
+ */
+static void
+walk_thread_init(struct prog_args *args, struct memory_state *mstate)
+{
+    struct walk_line *line;
+    long kb, k, j, tmp, seed;
+
+    kb = (args->walk_kb > 0) ? args->walk_kb : 1024L * args->memsize;
+    if (kb < 4) {
+	errx(1, "the walk kernel requires a working set (-W or -m) of "
+	     "at least 4 kB");
+    }
+    mstate->walk_size = kb * 1024 / WALK_LINE;
+    mstate->walk_pos = 0;
+    if (posix_memalign(&mstate->walk_lines, 4096,
+		       mstate->walk_size * WALK_LINE) != 0) {
+	errx(1, "%s: unable to allocate %ld kB", __func__, kb);
+    }
+
+    line = mstate->walk_lines;
+    for (k = 0; k < mstate->walk_size; k++) {
+	line[k].next = k;
+	line[k].val = k;
+    }
+    seed = 1;
+    for (k = mstate->walk_size - 1; k > 0; k--) {
+	seed = random_gen(seed);
+	j = seed % k;
+	tmp = line[k].next;
+	line[k].next = line[j].next;
+	line[j].next = tmp;
+    }
+}
+
+static void
+walk_thread_fini(struct memory_state *mstate)
+{
+    free(mstate->walk_lines);
+    mstate->walk_lines = NULL;
+}
+
+/*
+ *  Each unit is scale accesses, one line each.  The sum of the values
+ *  read must match the sum of the indices visited.
+ */
+static int
+walk_run(struct memory_state *mstate, int work)
+{
+    struct walk_line *line = mstate->walk_lines;
+    long size = mstate->walk_size;
+    long pos = mstate->walk_pos;
+    long seed = mstate->seed;
+    long n, sum, expect;
+    int num_errs = 0;
+
+    if (line == NULL)
+	return 1;
+
+    for (; work > 0; work--) {
+	sum = 0;
+	expect = 0;
+	switch (walk_pattern) {
+	case WALK_SEQ:
+	case WALK_STRIDE:
+	    for (n = 0; n < walk_kernel.scale; n++) {
+		sum += line[pos].val;
+		line[pos].val = pos;
+		expect += pos;
+		pos += walk_stride;
+		if (pos >= size)
+		    pos %= size;
+	    }
+	    break;
+
+	case WALK_RANDOM:
+	    for (n = 0; n < walk_kernel.scale; n++) {
+		seed = random_gen(seed);
+		pos = seed % size;
+		sum += line[pos].val;
+		line[pos].val = pos;
+		expect += pos;
+	    }
+	    break;
+
+	case WALK_CHASE:
+	    for (n = 0; n < walk_kernel.scale; n++) {
+		pos = line[pos].next;
+		sum += line[pos].val;
+		expect += pos;
+	    }
+	    break;
+	}
+	if (sum != expect) {
+	    warnx("%s: sum is out of range: %ld, expected %ld",
+		  __func__, sum, expect);
+	    num_errs++;
+	}
+    }
+    mstate->walk_pos = pos;
+    mstate->seed = seed;
+
+    return (num_errs);
+}
+
+struct work_kernel walk_kernel = {
+    "walk", "seq, stride, random or chase over -W kB (see -a)",
+    "PAPI_L1_DCM PAPI_L2_DCM PAPI_L3_TCM PAPI_TLB_DM",
+    walk_init, walk_thread_init, walk_thread_fini, walk_run,
+    WALK_SCALE, 0, 0, 0, 0, 0,
+};